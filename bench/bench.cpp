@@ -0,0 +1,466 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <malloc.h>
+#include <map>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "corpus.h"
+#include "lazy.h"
+#include "scheme.h"
+
+namespace {
+
+std::atomic<size_t> allocation_count{0};
+std::atomic<size_t> allocation_bytes{0};
+
+}  // namespace
+
+void* operator new(size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    allocation_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+namespace {
+
+struct Options {
+    size_t target_bytes = 1 << 20;
+    size_t repeat = 5;
+    uint64_t seed = 42;
+    std::string filter;
+    std::string save_path;
+    std::string baseline_path;
+    // Another build of this benchmark to run in alternating rounds, see CompareWithBinary.
+    std::string compare_path;
+    size_t rounds = 5;
+    double threshold = 0.10;
+    // Print regressions but exit with 0.
+    bool report_only = false;
+};
+
+#ifdef SCHEME_METRICS
+const bool kMetricsEnabled = true;
+#else
+const bool kMetricsEnabled = false;
+#endif
+
+const size_t kLazySublistThreshold = 256;
+
+struct StageResult {
+    std::string key;  // corpus.stage
+    double seconds = 0;
+    double megabytes_per_second = 0;
+    double units_per_second = 0;
+    const char* unit = "forms/s";
+    double allocations_per_run = 0;
+    double bytes_allocated_per_run = 0;
+    size_t peak_rss_kb = 0;
+    size_t errors = 0;
+};
+
+// Returns freed heap memory to the kernel and resets its peak RSS counter, so that VmHWM
+// reflects only the next stage.
+void ResetPeakRss() {
+    malloc_trim(0);
+    std::ofstream clear_refs("/proc/self/clear_refs");
+    clear_refs << "5";
+}
+
+size_t ReadPeakRssKb() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) {
+            return std::strtoull(line.c_str() + 6, nullptr, 10);
+        }
+    }
+    return 0;
+}
+
+std::vector<std::shared_ptr<Object>> ReadAll(const std::string& text) {
+    std::stringstream in(text);
+    Tokenizer tokenizer(&in);
+    std::vector<std::shared_ptr<Object>> forms;
+    while (!tokenizer.IsEnd()) {
+        forms.push_back(Read(&tokenizer));
+    }
+    return forms;
+}
+
+// Runs body options.repeat times and keeps the fastest run. body returns the number of
+// units it processed and the number of errors it hit.
+template <class Body>
+StageResult RunStage(const Options& options, const Corpus& corpus, const std::string& stage,
+                     Body body) {
+    StageResult result;
+    result.key = corpus.name + "." + stage;
+    result.seconds = 1e30;
+    ResetPeakRss();
+    size_t units = 0;
+    auto allocations_before = allocation_count.load();
+    auto bytes_before = allocation_bytes.load();
+    for (size_t i = 0; i < options.repeat; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        std::pair<size_t, size_t> processed = body();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        result.seconds = std::min(result.seconds, elapsed.count());
+        units = processed.first;
+        result.errors = processed.second;
+    }
+    result.allocations_per_run =
+        static_cast<double>(allocation_count.load() - allocations_before) / options.repeat;
+    result.bytes_allocated_per_run =
+        static_cast<double>(allocation_bytes.load() - bytes_before) / options.repeat;
+    result.peak_rss_kb = ReadPeakRssKb();
+    result.megabytes_per_second = corpus.text.size() / result.seconds / (1 << 20);
+    result.units_per_second = units / result.seconds;
+    return result;
+}
+
+std::vector<StageResult> RunCorpus(const Options& options, const Corpus& corpus) {
+    std::vector<StageResult> results;
+
+    auto tokenize = RunStage(options, corpus, "tokenize", [&] {
+        std::stringstream in(corpus.text);
+        Tokenizer tokenizer(&in);
+        size_t tokens = 0;
+        while (!tokenizer.IsEnd()) {
+            tokenizer.Next();
+            ++tokens;
+        }
+        return std::make_pair(tokens, size_t(0));
+    });
+    tokenize.unit = "tokens/s";
+    results.push_back(tokenize);
+
+    results.push_back(RunStage(options, corpus, "read", [&] {
+        auto forms = ReadAll(corpus.text);
+        return std::make_pair(forms.size(), size_t(0));
+    }));
+
+    // Same as read, with every object charged to a MemoryAccount.
+    results.push_back(RunStage(options, corpus, "read-accounted", [&] {
+        MemoryScope memory_scope(MemoryAccount::Create());
+        auto forms = ReadAll(corpus.text);
+        return std::make_pair(forms.size(), size_t(0));
+    }));
+
+    results.push_back(RunStage(options, corpus, "lazy-read", [&] {
+        LazyReader reader(corpus.text);
+        std::vector<std::shared_ptr<Object>> forms;
+        while (!reader.IsEnd()) {
+            forms.push_back(reader.Read());
+        }
+        return std::make_pair(forms.size(), size_t(0));
+    }));
+
+    // Reads the whole corpus but evaluates only every kPartialStride-th form, which is
+    // where deferring the parse pays off.
+    if (corpus.evaluable) {
+        const size_t kPartialStride = 10;
+        SchemeInterpretor interpretor;
+        auto partial_eager = RunStage(options, corpus, "partial-eager", [&] {
+            auto forms = ReadAll(corpus.text);
+            size_t errors = 0;
+            for (size_t i = 0; i < forms.size(); i += kPartialStride) {
+                try {
+                    interpretor.Eval(forms[i]);
+                } catch (const std::exception&) {
+                    ++errors;
+                }
+            }
+            return std::make_pair(forms.size(), errors);
+        });
+        results.push_back(partial_eager);
+
+        auto partial_lazy = RunStage(options, corpus, "partial-lazy", [&] {
+            LazyReader reader(corpus.text, kLazySublistThreshold);
+            std::vector<std::shared_ptr<Object>> forms;
+            while (!reader.IsEnd()) {
+                forms.push_back(reader.Read());
+            }
+            size_t errors = 0;
+            for (size_t i = 0; i < forms.size(); i += kPartialStride) {
+                try {
+                    interpretor.Eval(forms[i]);
+                } catch (const std::exception&) {
+                    ++errors;
+                }
+            }
+            return std::make_pair(forms.size(), errors);
+        });
+        results.push_back(partial_lazy);
+    }
+
+    auto forms = ReadAll(corpus.text);
+
+    if (corpus.evaluable) {
+        SchemeInterpretor interpretor;
+        auto eval = RunStage(options, corpus, "eval", [&] {
+            size_t errors = 0;
+            for (const auto& form : forms) {
+                try {
+                    interpretor.Eval(form);
+                } catch (const std::exception&) {
+                    ++errors;
+                }
+            }
+            return std::make_pair(forms.size(), errors);
+        });
+        eval.unit = "evals/s";
+        results.push_back(eval);
+    }
+
+    results.push_back(RunStage(options, corpus, "print", [&] {
+        std::stringstream out;
+        for (const auto& form : forms) {
+            PrintTo(form, &out);
+            out << ' ';
+        }
+        return std::make_pair(forms.size(), size_t(0));
+    }));
+
+    return results;
+}
+
+std::vector<StageResult> RunAll(const Options& options) {
+    std::vector<StageResult> results;
+    for (const auto& corpus : MakeAllCorpora(options.target_bytes, options.seed)) {
+        if (!options.filter.empty() && corpus.name != options.filter) {
+            continue;
+        }
+        auto corpus_results = RunCorpus(options, corpus);
+        results.insert(results.end(), corpus_results.begin(), corpus_results.end());
+    }
+    return results;
+}
+
+void PrintResults(const std::vector<StageResult>& results) {
+    std::cout << "metrics: " << (kMetricsEnabled ? "on" : "off") << "\n";
+    std::cout << std::left << std::setw(24) << "stage" << std::right << std::setw(10) << "MB/s"
+              << std::setw(16) << "rate" << std::setw(10) << "unit" << std::setw(14)
+              << "allocs/run" << std::setw(14) << "MB alloc/run" << std::setw(14)
+              << "peak RSS KB" << std::setw(8) << "errors" << "\n";
+    for (const auto& result : results) {
+        std::cout << std::left << std::setw(24) << result.key << std::right << std::fixed
+                  << std::setprecision(2) << std::setw(10) << result.megabytes_per_second
+                  << std::setprecision(0) << std::setw(16) << result.units_per_second
+                  << std::setw(10) << result.unit << std::setw(14)
+                  << result.allocations_per_run << std::setprecision(2) << std::setw(14)
+                  << result.bytes_allocated_per_run / (1 << 20) << std::setw(14)
+                  << result.peak_rss_kb << std::setw(8) << result.errors << "\n";
+    }
+}
+
+// Baseline files hold one "<corpus.stage> <MB/s>" pair per line.
+void SaveBaseline(const std::string& path, const std::vector<StageResult>& results) {
+    std::ofstream out(path);
+    out << std::setprecision(6);
+    for (const auto& result : results) {
+        out << result.key << ' ' << result.megabytes_per_second << "\n";
+    }
+}
+
+std::vector<StageResult> LoadResults(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error("can't open baseline " + path);
+    }
+    std::vector<StageResult> results;
+    StageResult result;
+    while (in >> result.key >> result.megabytes_per_second) {
+        results.push_back(result);
+    }
+    return results;
+}
+
+std::map<std::string, double> LoadBaseline(const std::string& path) {
+    std::map<std::string, double> baseline;
+    for (const auto& result : LoadResults(path)) {
+        baseline[result.key] = result.megabytes_per_second;
+    }
+    return baseline;
+}
+
+// Returns the number of stages that got slower than the baseline by more than the threshold.
+// noise holds, per stage, how far the baseline's own runs were apart, if that is known.
+size_t Compare(const Options& options, const std::string& name,
+               const std::map<std::string, double>& baseline,
+               const std::vector<StageResult>& results,
+               const std::map<std::string, double>& noise = {}) {
+    size_t regressions = 0;
+    std::cout << std::fixed << std::setprecision(1) << "\ncomparison with " << name
+              << " (threshold " << options.threshold * 100 << "%)\n";
+    for (const auto& result : results) {
+        auto it = baseline.find(result.key);
+        if (it == baseline.end() || it->second <= 0) {
+            continue;
+        }
+        double change = result.megabytes_per_second / it->second - 1;
+        bool regressed = change < -options.threshold;
+        regressions += regressed;
+        std::cout << std::left << std::setw(24) << result.key << std::right << std::showpos
+                  << std::setw(9) << change * 100 << "%" << std::noshowpos;
+        auto spread = noise.find(result.key);
+        if (spread != noise.end()) {
+            std::cout << "   noise " << std::setw(5) << spread->second * 100 << "%";
+        }
+        std::cout << (regressed ? "  REGRESSION" : "") << "\n";
+    }
+    return regressions;
+}
+
+// Keeps the fastest run of each stage.
+void MergeBest(const std::vector<StageResult>& results, std::vector<StageResult>* best) {
+    for (const auto& result : results) {
+        auto it = std::find_if(best->begin(), best->end(), [&](const StageResult& other) {
+            return other.key == result.key;
+        });
+        if (it == best->end()) {
+            best->push_back(result);
+        } else if (result.megabytes_per_second > it->megabytes_per_second) {
+            *it = result;
+        }
+    }
+}
+
+// Runs this benchmark and the one at options.compare_path in alternating rounds and keeps each
+// stage's best rate on both sides, so that the machine speeding up or slowing down over the
+// run affects both alike. Both sides run as fresh child processes; measuring this process
+// against a fresh one is skewed by the heap state earlier rounds leave behind. Used to measure
+// what SCHEME_METRICS costs: one build has it on and the other off. The spread between the other
+// binary's rounds is reported as the noise; changes within it mean nothing.
+size_t CompareWithBinary(const Options& options, const std::string& self_path) {
+    std::string results_path = "/tmp/scheme_bench_compare." + std::to_string(getpid());
+    auto run = [&](const std::string& binary) {
+        std::ostringstream command;
+        command << binary << " --size " << options.target_bytes << " --repeat "
+                << options.repeat << " --seed " << options.seed << " --save " << results_path;
+        if (!options.filter.empty()) {
+            command << " --filter " << options.filter;
+        }
+        command << " > /dev/null";
+        if (std::system(command.str().c_str()) != 0) {
+            throw std::runtime_error("can't run " + binary);
+        }
+        return LoadResults(results_path);
+    };
+
+    std::vector<StageResult> ours;
+    std::vector<StageResult> theirs;
+    std::map<std::string, std::pair<double, double>> their_range;
+    for (size_t round = 0; round < options.rounds; ++round) {
+        MergeBest(run(self_path), &ours);
+        auto results = run(options.compare_path);
+        for (const auto& result : results) {
+            auto inserted = their_range.emplace(
+                result.key, std::make_pair(result.megabytes_per_second,
+                                           result.megabytes_per_second));
+            auto& range = inserted.first->second;
+            range.first = std::min(range.first, result.megabytes_per_second);
+            range.second = std::max(range.second, result.megabytes_per_second);
+        }
+        MergeBest(results, &theirs);
+    }
+    std::remove(results_path.c_str());
+
+    std::map<std::string, double> baseline;
+    for (const auto& result : theirs) {
+        baseline[result.key] = result.megabytes_per_second;
+    }
+    std::map<std::string, double> noise;
+    for (const auto& [key, range] : their_range) {
+        if (range.first > 0) {
+            noise[key] = range.second / range.first - 1;
+        }
+    }
+    std::cout << "metrics: " << (kMetricsEnabled ? "on" : "off") << "\n";
+    return Compare(options, options.compare_path, baseline, ours, noise);
+}
+
+void Usage(const char* name) {
+    std::cerr << "usage: " << name
+              << " [--size BYTES] [--repeat N] [--seed N] [--filter CORPUS]\n"
+                 "       [--save FILE] [--baseline FILE] [--threshold FRACTION]\n"
+                 "       [--compare OTHER_BENCH_BINARY [--rounds N]] [--report-only]\n";
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--report-only") {
+            options.report_only = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            Usage(argv[0]);
+            return 2;
+        }
+        std::string value = argv[++i];
+        if (arg == "--size") {
+            options.target_bytes = std::stoull(value);
+        } else if (arg == "--repeat") {
+            options.repeat = std::max<size_t>(1, std::stoull(value));
+        } else if (arg == "--seed") {
+            options.seed = std::stoull(value);
+        } else if (arg == "--filter") {
+            options.filter = value;
+        } else if (arg == "--save") {
+            options.save_path = value;
+        } else if (arg == "--baseline") {
+            options.baseline_path = value;
+        } else if (arg == "--threshold") {
+            options.threshold = std::stod(value);
+        } else if (arg == "--compare") {
+            options.compare_path = value;
+        } else if (arg == "--rounds") {
+            options.rounds = std::max<size_t>(1, std::stoull(value));
+        } else {
+            Usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (!options.compare_path.empty()) {
+        return CompareWithBinary(options, argv[0]) > 0 && !options.report_only ? 1 : 0;
+    }
+
+    auto results = RunAll(options);
+    PrintResults(results);
+
+    if (!options.save_path.empty()) {
+        SaveBaseline(options.save_path, results);
+    }
+    if (!options.baseline_path.empty() &&
+        Compare(options, options.baseline_path, LoadBaseline(options.baseline_path), results) > 0 &&
+        !options.report_only) {
+        return 1;
+    }
+    return 0;
+}
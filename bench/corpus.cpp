@@ -0,0 +1,174 @@
+#include "corpus.h"
+
+namespace {
+
+// splitmix64, so that the output does not depend on the standard library's distributions.
+class Random {
+public:
+    explicit Random(uint64_t seed) : state_(seed) {
+    }
+
+    uint64_t Next() {
+        uint64_t z = (state_ += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    // Uniform in [lo, hi].
+    int64_t Range(int64_t lo, int64_t hi) {
+        return lo + static_cast<int64_t>(Next() % static_cast<uint64_t>(hi - lo + 1));
+    }
+
+private:
+    uint64_t state_;
+};
+
+void AppendForm(Corpus* corpus, const std::string& form) {
+    if (!corpus->text.empty()) {
+        corpus->text += ' ';
+    }
+    corpus->text += form;
+    ++corpus->forms;
+}
+
+std::string MakeSymbolName(Random* random) {
+    static const char* kAlphabet = "abcdefghijklmnopqrstuvwxyz";
+    std::string name;
+    auto length = random->Range(1, 12);
+    for (int64_t i = 0; i < length; ++i) {
+        name += kAlphabet[random->Range(0, 25)];
+    }
+    switch (random->Range(0, 7)) {
+        case 0:
+            name += '?';
+            break;
+        case 1:
+            name += '!';
+            break;
+        case 2:
+            name += "-" + std::to_string(random->Range(0, 99));
+            break;
+        default:
+            break;
+    }
+    return name;
+}
+
+void AppendArithmetic(Random* random, int depth, std::string* out) {
+    if (depth == 0 || random->Range(0, 3) == 0) {
+        *out += std::to_string(random->Range(1, 9));
+        return;
+    }
+    // Keep the results small enough not to overflow, and never pass 0 as the first
+    // argument of -.
+    auto op = depth <= 2 ? random->Range(0, 2) : random->Range(0, 1);
+    if (op == 0) {
+        *out += "(+";
+        auto arity = random->Range(2, 4);
+        for (int64_t i = 0; i < arity; ++i) {
+            *out += ' ';
+            AppendArithmetic(random, depth - 1, out);
+        }
+    } else if (op == 1) {
+        *out += "(- " + std::to_string(random->Range(100, 999));
+        auto arity = random->Range(1, 3);
+        for (int64_t i = 0; i < arity; ++i) {
+            *out += ' ';
+            AppendArithmetic(random, depth - 1, out);
+        }
+    } else {
+        *out += "(* ";
+        AppendArithmetic(random, depth - 1, out);
+        *out += ' ';
+        AppendArithmetic(random, depth - 1, out);
+    }
+    *out += ')';
+}
+
+}  // namespace
+
+Corpus MakeNestedCorpus(size_t target_bytes, uint64_t seed) {
+    Random random(seed);
+    Corpus corpus{"nested", "", 0, true};
+    while (corpus.text.size() < target_bytes) {
+        auto depth = random.Range(100, 1000);
+        std::string form;
+        for (int64_t i = 0; i < depth; ++i) {
+            form += "(+ " + std::to_string(random.Range(1, 9)) + " ";
+        }
+        form += std::to_string(random.Range(1, 9));
+        form.append(depth, ')');
+        AppendForm(&corpus, form);
+    }
+    return corpus;
+}
+
+Corpus MakeFlatCorpus(size_t target_bytes, uint64_t seed) {
+    Random random(seed);
+    Corpus corpus{"flat", "", 0, true};
+    while (corpus.text.size() < target_bytes) {
+        auto width = random.Range(1000, 10000);
+        std::string form = "(+";
+        for (int64_t i = 0; i < width; ++i) {
+            form += " " + std::to_string(random.Range(1, 9));
+        }
+        form += ')';
+        AppendForm(&corpus, form);
+    }
+    return corpus;
+}
+
+Corpus MakeNumberCorpus(size_t target_bytes, uint64_t seed) {
+    Random random(seed);
+    Corpus corpus{"numbers", "", 0, true};
+    while (corpus.text.size() < target_bytes) {
+        auto width = random.Range(1, 16);
+        std::string form = "(+";
+        for (int64_t i = 0; i < width; ++i) {
+            form += " " + std::to_string(random.Range(-999999, 999999));
+        }
+        form += ')';
+        AppendForm(&corpus, form);
+    }
+    return corpus;
+}
+
+Corpus MakeSymbolCorpus(size_t target_bytes, uint64_t seed) {
+    Random random(seed);
+    Corpus corpus{"symbols", "", 0, false};
+    while (corpus.text.size() < target_bytes) {
+        auto width = random.Range(1, 16);
+        std::string form = "(";
+        for (int64_t i = 0; i < width; ++i) {
+            if (i != 0) {
+                form += ' ';
+            }
+            form += MakeSymbolName(&random);
+        }
+        form += ')';
+        AppendForm(&corpus, form);
+    }
+    return corpus;
+}
+
+Corpus MakeArithmeticCorpus(size_t target_bytes, uint64_t seed) {
+    Random random(seed);
+    Corpus corpus{"arithmetic", "", 0, true};
+    while (corpus.text.size() < target_bytes) {
+        std::string form;
+        AppendArithmetic(&random, 6, &form);
+        AppendForm(&corpus, form);
+    }
+    return corpus;
+}
+
+std::vector<Corpus> MakeAllCorpora(size_t target_bytes, uint64_t seed) {
+    std::vector<Corpus> corpora;
+    corpora.push_back(MakeNestedCorpus(target_bytes, seed));
+    corpora.push_back(MakeFlatCorpus(target_bytes, seed));
+    corpora.push_back(MakeNumberCorpus(target_bytes, seed));
+    corpora.push_back(MakeSymbolCorpus(target_bytes, seed));
+    corpora.push_back(MakeArithmeticCorpus(target_bytes, seed));
+    return corpora;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Deterministic synthetic inputs for the benchmarks. The same seed and size always produce
+// the same text. Forms are separated by single spaces, which is all the tokenizer accepts.
+struct Corpus {
+    std::string name;
+    std::string text;
+    size_t forms = 0;
+    bool evaluable = false;
+};
+
+Corpus MakeNestedCorpus(size_t target_bytes, uint64_t seed);
+
+Corpus MakeFlatCorpus(size_t target_bytes, uint64_t seed);
+
+Corpus MakeNumberCorpus(size_t target_bytes, uint64_t seed);
+
+Corpus MakeSymbolCorpus(size_t target_bytes, uint64_t seed);
+
+Corpus MakeArithmeticCorpus(size_t target_bytes, uint64_t seed);
+
+std::vector<Corpus> MakeAllCorpora(size_t target_bytes, uint64_t seed);
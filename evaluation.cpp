@@ -0,0 +1,213 @@
+#include "evaluation.h"
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <new>
+#include <utility>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "parser.h"
+#include "memory.h"
+#include "metrics.h"
+#include "profiler.h"
+
+namespace {
+
+thread_local Evaluation* current_evaluation = nullptr;
+
+thread_local size_t eval_depth = 0;
+
+#ifdef SCHEME_METRICS
+// Counted without touching the shared counters, which are updated once per top-level Eval
+// and once per Resume.
+thread_local uint64_t eval_calls = 0;
+thread_local uint64_t max_eval_depth = 0;
+
+void FlushEvalMetrics() {
+    auto& local = metrics::Local();
+    local.eval_calls.Add(eval_calls);
+    local.max_eval_depth.SetMax(max_eval_depth);
+    eval_calls = 0;
+    max_eval_depth = 0;
+}
+#endif
+
+const size_t kClockCheckMask = 63;
+
+}  // namespace
+
+EvaluationCancelled::EvaluationCancelled() : std::runtime_error("evaluation cancelled") {
+}
+
+EvaluationTooDeep::EvaluationTooDeep() : std::runtime_error("form is nested too deeply") {
+}
+
+Evaluation::Evaluation(std::shared_ptr<Object> form, std::shared_ptr<Scope> scope,
+                       std::shared_ptr<MemoryAccount> account, size_t stack_size)
+    : form_(form), scope_(scope), account_(account) {
+    guard_size_ = sysconf(_SC_PAGESIZE);
+    stack_size_ = (std::max(stack_size, 2 * kStackReserve) + guard_size_ - 1) / guard_size_ *
+                  guard_size_;
+    void* mapping = mmap(nullptr, guard_size_ + stack_size_, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+    if (mapping == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    if (mprotect(mapping, guard_size_, PROT_NONE) != 0) {
+        munmap(mapping, guard_size_ + stack_size_);
+        throw std::bad_alloc();
+    }
+    stack_ = static_cast<char*>(mapping) + guard_size_;
+}
+
+Evaluation::~Evaluation() {
+    if (started_ && !done_) {
+        // Unwind the suspended stack so that everything it holds gets released.
+        cancelled_ = true;
+        Resume(0);
+    }
+    ReleaseStack();
+}
+
+void Evaluation::ReleaseStack() {
+    if (stack_) {
+        munmap(stack_ - guard_size_, guard_size_ + stack_size_);
+        stack_ = nullptr;
+    }
+}
+
+bool Evaluation::Resume(size_t max_steps, std::chrono::nanoseconds time_slice) {
+    if (done_) {
+        return true;
+    }
+    budget_ = max_steps > std::numeric_limits<size_t>::max() - steps_
+                  ? std::numeric_limits<size_t>::max()
+                  : steps_ + max_steps;
+    has_deadline_ = time_slice != std::chrono::nanoseconds::zero();
+    if (has_deadline_) {
+        deadline_ = std::chrono::steady_clock::now() + time_slice;
+    }
+    if (!started_) {
+        started_ = true;
+        getcontext(&context_);
+        context_.uc_stack.ss_sp = stack_;
+        context_.uc_stack.ss_size = stack_size_;
+        context_.uc_link = &caller_;
+        auto self = reinterpret_cast<uintptr_t>(this);
+        makecontext(&context_, reinterpret_cast<void (*)()>(&Evaluation::Entry), 2,
+                    static_cast<unsigned int>(self & 0xffffffffu),
+                    static_cast<unsigned int>(static_cast<uint64_t>(self) >> 32));
+    }
+    MemoryScope memory_scope(account_);
+    outer_ = current_evaluation;
+    current_evaluation = this;
+    std::swap(eval_depth, depth_);
+    profiler::SwapFrames(&profile_frames_);
+    swapcontext(&caller_, &context_);
+    profiler::SwapFrames(&profile_frames_);
+    std::swap(eval_depth, depth_);
+#ifdef SCHEME_METRICS
+    FlushEvalMetrics();
+#endif
+    current_evaluation = outer_;
+    outer_ = nullptr;
+    if (done_) {
+        ReleaseStack();
+    }
+    return done_;
+}
+
+bool Evaluation::IsDone() const {
+    return done_;
+}
+
+size_t Evaluation::StepsTaken() const {
+    return steps_;
+}
+
+std::shared_ptr<Object> Evaluation::GetResult() const {
+    if (!done_) {
+        throw std::runtime_error("evaluation is not finished");
+    }
+    if (error_) {
+        std::rethrow_exception(error_);
+    }
+    return result_;
+}
+
+void Evaluation::Entry(unsigned int lo, unsigned int hi) {
+    auto self = static_cast<uintptr_t>((static_cast<uint64_t>(hi) << 32) | lo);
+    reinterpret_cast<Evaluation*>(self)->Run();
+}
+
+void Evaluation::Run() {
+    try {
+        if (cancelled_) {
+            throw EvaluationCancelled();
+        }
+        result_ = form_->Eval(scope_);
+    } catch (...) {
+        error_ = std::current_exception();
+    }
+    form_.reset();
+    scope_.reset();
+    done_ = true;
+}
+
+void Evaluation::Step() {
+    CheckStack();
+    // A step is counted only once it proceeds, so the one a slice stops at is charged to the
+    // slice that runs it.
+    bool out_of_time = has_deadline_ && ((steps_ + 1) & kClockCheckMask) == 0 &&
+                       std::chrono::steady_clock::now() >= deadline_;
+    if (!cancelled_ && (steps_ >= budget_ || out_of_time)) {
+        do {
+            swapcontext(&context_, &caller_);
+        } while (!cancelled_ && steps_ >= budget_);
+    }
+    if (cancelled_) {
+        throw EvaluationCancelled();
+    }
+    ++steps_;
+}
+
+void Evaluation::CheckStack() const {
+    // Stacks grow down on every platform ucontext is used on here.
+    char marker;
+    auto stack_left = reinterpret_cast<uintptr_t>(&marker) - reinterpret_cast<uintptr_t>(stack_);
+    if (stack_left < kStackReserve && !cancelled_) {
+        throw EvaluationTooDeep();
+    }
+}
+
+void EvalStep() {
+    if (current_evaluation) {
+        current_evaluation->Step();
+    }
+}
+
+void CheckEvalStack() {
+    if (current_evaluation) {
+        current_evaluation->CheckStack();
+    }
+}
+
+EvalDepthScope::EvalDepthScope() {
+    if (eval_depth == kMaxEvalDepth) {
+        throw EvaluationTooDeep();
+    }
+    ++eval_depth;
+#ifdef SCHEME_METRICS
+    ++eval_calls;
+    max_eval_depth = std::max<uint64_t>(max_eval_depth, eval_depth);
+#endif
+}
+
+EvalDepthScope::~EvalDepthScope() {
+#ifdef SCHEME_METRICS
+    if (eval_depth == 1) {
+        FlushEvalMetrics();
+    }
+#endif
+    --eval_depth;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include <ucontext.h>
+
+class Object;
+class Scope;
+class Cell;
+class MemoryAccount;
+
+struct EvaluationCancelled : public std::runtime_error {
+    EvaluationCancelled();
+};
+
+// Thrown inside the evaluation when the form is nested too deeply for its stack.
+struct EvaluationTooDeep : public std::runtime_error {
+    EvaluationTooDeep();
+};
+
+// Resumable evaluation of a single form. The form is evaluated on its own stack, and every
+// Cell::Eval and builtin Apply counts as one step. When the step budget (or time slice) given
+// to Resume runs out, the evaluation suspends and control returns to the caller of Resume.
+class Evaluation {
+public:
+    // Enough for kMaxEvalDepth nested calls in an optimized build.
+    static const size_t kDefaultStackSize = 2 << 20;
+
+    // Stack left unused by the evaluation, for exception unwinding and deep library calls.
+    static const size_t kStackReserve = 64 << 10;
+
+    // Objects allocated while the evaluation runs are charged to account, if it is set.
+    Evaluation(std::shared_ptr<Object> form, std::shared_ptr<Scope> scope,
+               std::shared_ptr<MemoryAccount> account = nullptr,
+               size_t stack_size = kDefaultStackSize);
+
+    Evaluation(const Evaluation&) = delete;
+
+    Evaluation& operator=(const Evaluation&) = delete;
+
+    ~Evaluation();
+
+    // Runs for at most max_steps steps (SIZE_MAX for no limit), or until time_slice elapses if
+    // it is non-zero. Returns true once the evaluation has finished.
+    bool Resume(size_t max_steps,
+                std::chrono::nanoseconds time_slice = std::chrono::nanoseconds::zero());
+
+    bool IsDone() const;
+
+    size_t StepsTaken() const;
+
+    // Rethrows the error if the evaluation failed.
+    std::shared_ptr<Object> GetResult() const;
+
+private:
+    static void Entry(unsigned int lo, unsigned int hi);
+
+    void Run();
+
+    void Step();
+
+    void CheckStack() const;
+
+    void ReleaseStack();
+
+    friend void EvalStep();
+
+    friend void CheckEvalStack();
+
+    std::shared_ptr<Object> form_;
+    std::shared_ptr<Scope> scope_;
+    std::shared_ptr<MemoryAccount> account_;
+    std::shared_ptr<Object> result_;
+    std::exception_ptr error_;
+
+    // Mapped lazily by the kernel, so that only the pages the evaluation touches get committed.
+    // The lowest page is a guard page; stack_ points just above it.
+    char* stack_ = nullptr;
+    size_t stack_size_;
+    size_t guard_size_;
+    ucontext_t caller_;
+    ucontext_t context_;
+
+    bool started_ = false;
+    bool done_ = false;
+    bool cancelled_ = false;
+    size_t steps_ = 0;
+    size_t budget_ = 0;
+    std::chrono::steady_clock::time_point deadline_;
+    bool has_deadline_ = false;
+    Evaluation* outer_ = nullptr;
+    size_t depth_ = 0;
+    std::vector<const Cell*> profile_frames_;
+};
+
+// Suspension point. A no-op unless called from inside Evaluation::Resume.
+void EvalStep();
+
+// Throws EvaluationTooDeep when called from inside Evaluation::Resume with less than
+// Evaluation::kStackReserve of the evaluation's stack left.
+void CheckEvalStack();
+
+// Deepest Cell::Eval nesting allowed. Evaluations stop before their own stack runs out anyway;
+// this keeps plain Eval well within the 8 MiB a thread's stack usually has, even unoptimized.
+const size_t kMaxEvalDepth = 4096;
+
+// Counts Cell::Eval nesting on the current thread (inside Resume, in that evaluation) and
+// throws EvaluationTooDeep past kMaxEvalDepth.
+class EvalDepthScope {
+public:
+    EvalDepthScope();
+
+    EvalDepthScope(const EvalDepthScope&) = delete;
+
+    EvalDepthScope& operator=(const EvalDepthScope&) = delete;
+
+    ~EvalDepthScope();
+};
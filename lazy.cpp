@@ -0,0 +1,233 @@
+#include "lazy.h"
+#include <istream>
+#include <stdexcept>
+#include <streambuf>
+#include "memory.h"
+#include "metrics.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Read-only stream buffer over a part of the source, so that spans are parsed in place
+// instead of being copied into a stringstream.
+class SpanBuffer : public std::streambuf {
+public:
+    SpanBuffer(const char* begin, const char* end) {
+        char* first = const_cast<char*>(begin);
+        setg(first, first, const_cast<char*>(end));
+    }
+
+    size_t Position() const {
+        return gptr() - eback();
+    }
+
+    size_t Size() const {
+        return egptr() - eback();
+    }
+
+    void Seek(size_t position) {
+        setg(eback(), eback() + position, egptr());
+    }
+};
+
+namespace {
+
+struct LazyContext {
+    const std::shared_ptr<const std::string>& source;
+    // Offset of the span buffer in source.
+    size_t base;
+    SpanBuffer* buffer;
+    std::istream* stream;
+    size_t sublist_threshold;
+};
+
+std::shared_ptr<Object> ReadLazyList(Tokenizer* tokenizer, LazyContext* context);
+
+bool IsBlank(const std::string& source, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+        if (source[i] != ' ') {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Same as Read, except that lists are deferred: all of them if defer_lists is set, and
+// otherwise the ones at least sublist_threshold bytes long.
+std::shared_ptr<Object> ReadLazy(Tokenizer* tokenizer, LazyContext* context, bool defer_lists) {
+    if (tokenizer->IsEnd()) {
+        return nullptr;
+    }
+    ReadDepthScope depth_scope;
+    auto current_object = tokenizer->GetToken();
+    if (SymbolToken* symbol = std::get_if<SymbolToken>(&current_object)) {
+        tokenizer->Next();
+        return MakeObject<Symbol>(symbol->name);
+    } else if (ConstantToken* constant = std::get_if<ConstantToken>(&current_object)) {
+        tokenizer->Next();
+        return MakeObject<Number>(constant->value);
+    } else if (std::holds_alternative<QuoteToken>(current_object)) {
+        tokenizer->Next();
+        auto new_cell = MakeObject<Cell>();
+        new_cell->SetFirst(MakeObject<Symbol>("quote"));
+        new_cell->SetSecond(MakeObject<Cell>(ReadLazy(tokenizer, context, defer_lists), nullptr));
+        return new_cell;
+    } else if (std::holds_alternative<DotToken>(current_object)) {
+        throw SyntaxError("Unexpected symbol");
+    } else if (BracketToken* bracket = std::get_if<BracketToken>(&current_object)) {
+        if (*bracket == BracketToken::CLOSE) {
+            throw SyntaxError("Unexpected closing parentheses");
+        }
+        // The tokenizer stops right after the opening parenthesis.
+        auto& source = *context->source;
+        size_t begin = context->base + context->buffer->Position();
+        size_t limit = context->base + context->buffer->Size();
+        bool defer = defer_lists;
+        if (!defer && context->sublist_threshold != LazyReader::kNoSublists) {
+            // Lists parsed right away are scanned only as far as the threshold, so that
+            // reading nested lists doesn't rescan the rest of the span at every level.
+            size_t window = limit - begin > context->sublist_threshold
+                                ? begin + context->sublist_threshold
+                                : limit;
+            defer = FindClosingBracket(source.data(), begin, window) == window;
+        }
+        if (defer) {
+            size_t close = FindClosingBracket(source.data(), begin, limit);
+            if (close == limit) {
+                throw SyntaxError("Unmatched opening parentheses");
+            }
+            if (!IsBlank(source, begin, close)) {
+                context->buffer->Seek(close + 1 - context->base);
+                context->stream->clear();
+                tokenizer->Next();
+                return MakeObject<Cell>(MakeObject<LazySpan>(
+                    context->source, begin, close + 1, context->sublist_threshold));
+            }
+        }
+        tokenizer->Next();
+        return ReadLazyList(tokenizer, context);
+    }
+    throw SyntaxError("Unexpected symbol");
+}
+
+std::shared_ptr<Object> ReadLazyList(Tokenizer* tokenizer, LazyContext* context) {
+    if (tokenizer->IsEnd()) {
+        throw SyntaxError("Input not complete");
+    }
+    std::shared_ptr<Object> head = nullptr;
+    std::shared_ptr<Cell> tail = nullptr;
+    while (!tokenizer->IsEnd()) {
+        auto current_token = tokenizer->GetToken();
+        if (std::holds_alternative<BracketToken>(current_token) &&
+            std::get<BracketToken>(current_token) == BracketToken::CLOSE) {
+            tokenizer->Next();
+            return head;
+        } else if (std::holds_alternative<DotToken>(current_token)) {
+            tokenizer->Next();
+            if (tail == nullptr) {
+                throw SyntaxError("Improper list syntax");
+            }
+            tail->SetSecond(ReadLazy(tokenizer, context, false));
+            if (!std::holds_alternative<BracketToken>(tokenizer->GetToken()) ||
+                std::get<BracketToken>(tokenizer->GetToken()) != BracketToken::CLOSE) {
+                throw SyntaxError("Improper list syntax");
+            }
+        } else {
+            auto current_object = ReadLazy(tokenizer, context, false);
+            auto new_cell = MakeObject<Cell>();
+            new_cell->SetFirst(current_object);
+            if (head == nullptr) {
+                head = new_cell;
+                tail = new_cell;
+            } else {
+                tail->SetSecond(new_cell);
+                tail = new_cell;
+            }
+        }
+    }
+    throw SyntaxError("Unmatched opening parentheses");
+}
+
+}  // namespace
+
+size_t FindClosingBracket(const char* data, size_t begin, size_t end) {
+    size_t depth = 1;
+    size_t pos = begin;
+#ifdef __SSE2__
+    const __m128i open = _mm_set1_epi8('(');
+    const __m128i close = _mm_set1_epi8(')');
+    for (; pos + 16 <= end; pos += 16) {
+        auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+        unsigned opens = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, open));
+        unsigned closes = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, close));
+        if (!closes) {
+            depth += __builtin_popcount(opens);
+            continue;
+        }
+        for (unsigned brackets = opens | closes; brackets; brackets &= brackets - 1) {
+            unsigned bit = brackets & -brackets;
+            if (opens & bit) {
+                ++depth;
+            } else if (--depth == 0) {
+                return pos + __builtin_ctz(bit);
+            }
+        }
+    }
+#endif
+    for (; pos < end; ++pos) {
+        if (data[pos] == '(') {
+            ++depth;
+        } else if (data[pos] == ')' && --depth == 0) {
+            return pos;
+        }
+    }
+    return end;
+}
+
+LazySpan::LazySpan(std::shared_ptr<const std::string> source, size_t begin, size_t end,
+                   size_t sublist_threshold)
+    : source_(source), begin_(begin), end_(end), sublist_threshold_(sublist_threshold) {
+}
+
+void LazySpan::PrintTo(std::ostream* out) {
+    *out << '(';
+    out->write(source_->data() + begin_, end_ - begin_);
+}
+
+std::string_view LazySpan::Source() const {
+    return std::string_view(*source_).substr(begin_ - 1, end_ - begin_ + 1);
+}
+
+std::shared_ptr<Object> LazySpan::Eval(std::shared_ptr<Scope>) {
+    throw std::runtime_error("can't eval unparsed span");
+}
+
+std::shared_ptr<Cell> LazySpan::Materialize() const {
+    SpanBuffer buffer(source_->data() + begin_, source_->data() + end_);
+    std::istream stream(&buffer);
+    Tokenizer tokenizer(&stream);
+    LazyContext context{source_, begin_, &buffer, &stream, sublist_threshold_};
+    return AsCell(ReadLazyList(&tokenizer, &context));
+}
+
+LazyReader::LazyReader(std::string source, size_t sublist_threshold)
+    : source_(std::make_shared<const std::string>(std::move(source))),
+      sublist_threshold_(sublist_threshold),
+      buffer_(std::make_unique<SpanBuffer>(source_->data(), source_->data() + source_->size())),
+      stream_(std::make_unique<std::istream>(buffer_.get())),
+      tokenizer_(std::make_unique<Tokenizer>(stream_.get())) {
+}
+
+LazyReader::~LazyReader() = default;
+
+bool LazyReader::IsEnd() {
+    return tokenizer_->IsEnd();
+}
+
+std::shared_ptr<Object> LazyReader::Read() {
+    if (!tokenizer_->IsEnd()) {
+        SCHEME_METRICS_ADD(reader_forms, 1);
+    }
+    LazyContext context{source_, 0, buffer_.get(), stream_.get(), sublist_threshold_};
+    return ReadLazy(tokenizer_.get(), &context, true);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <string>
+#include <string_view>
+#include "parser.h"
+
+// Source text of a list that has not been parsed yet. A Cell holding one parses it the first
+// time GetFirst, GetSecond, Eval or PrintTo touches the cell.
+class LazySpan : public Object {
+public:
+    LazySpan(std::shared_ptr<const std::string> source, size_t begin, size_t end,
+             size_t sublist_threshold);
+
+    virtual void PrintTo(std::ostream* out) override;
+
+    virtual std::shared_ptr<Object> Eval(std::shared_ptr<Scope>) override;
+
+    // Parses the span into the list it stands for.
+    std::shared_ptr<Cell> Materialize() const;
+
+    // The list's source, parentheses included.
+    std::string_view Source() const;
+
+private:
+    std::shared_ptr<const std::string> source_;
+    // From just after the opening parenthesis up to and including the closing one.
+    size_t begin_;
+    size_t end_;
+    size_t sublist_threshold_;
+};
+
+class SpanBuffer;
+
+// Reads top-level forms without parsing the lists in them. Nested lists whose source is at
+// least sublist_threshold bytes long are deferred as well.
+class LazyReader {
+public:
+    static const size_t kNoSublists = std::numeric_limits<size_t>::max();
+
+    explicit LazyReader(std::string source, size_t sublist_threshold = kNoSublists);
+
+    LazyReader(const LazyReader&) = delete;
+
+    LazyReader& operator=(const LazyReader&) = delete;
+
+    ~LazyReader();
+
+    bool IsEnd();
+
+    std::shared_ptr<Object> Read();
+
+private:
+    std::shared_ptr<const std::string> source_;
+    size_t sublist_threshold_;
+    std::unique_ptr<SpanBuffer> buffer_;
+    std::unique_ptr<std::istream> stream_;
+    std::unique_ptr<Tokenizer> tokenizer_;
+};
+
+// Returns the position of the parenthesis closing the list that starts right before begin,
+// or end if there is none.
+size_t FindClosingBracket(const char* data, size_t begin, size_t end);
@@ -0,0 +1,193 @@
+#include "memory.h"
+#include <algorithm>
+#include <string>
+
+namespace {
+
+thread_local MemoryAccount* current_account = nullptr;
+
+const int64_t kChargeBatchBytes = 16 << 10;
+
+}  // namespace
+
+// Charges and releases made on this thread for account that its counters don't include yet.
+// Releases of objects charged earlier may make the totals negative.
+struct MemoryAccount::Batch {
+    MemoryAccount* account = nullptr;
+    int64_t bytes = 0;
+    int64_t bytes_by_type[kTypesCount] = {};
+    int64_t objects_by_type[kTypesCount] = {};
+};
+
+thread_local MemoryAccount::Batch MemoryAccount::pending_;
+
+MemoryLimitError::MemoryLimitError(size_t limit, size_t requested)
+    : std::runtime_error("memory limit of " + std::to_string(limit) + " bytes exceeded by a " +
+                         std::to_string(requested) + "-byte allocation") {
+}
+
+std::shared_ptr<MemoryAccount> MemoryAccount::Create() {
+    return std::shared_ptr<MemoryAccount>(new MemoryAccount(),
+                                          [](MemoryAccount* account) {
+                                              account->ReleaseBytes(kOwnerBias);
+                                          });
+}
+
+void MemoryAccount::ReleaseBytes(int64_t bytes) {
+    if (bytes_.fetch_sub(bytes, std::memory_order_acq_rel) == bytes) {
+        delete this;
+    }
+}
+
+void MemoryAccount::SetSoftLimit(size_t bytes, SoftLimitCallback callback) {
+    soft_limit_ = bytes;
+    soft_limit_callback_ = callback;
+    over_soft_limit_.store(false, std::memory_order_relaxed);
+}
+
+void MemoryAccount::SetHardLimit(size_t bytes) {
+    hard_limit_ = bytes;
+}
+
+int64_t MemoryAccount::Usage() const {
+    return bytes_.load(std::memory_order_relaxed) - kOwnerBias;
+}
+
+size_t MemoryAccount::CurrentBytes() const {
+    return std::max<int64_t>(Usage(), 0);
+}
+
+size_t MemoryAccount::PeakBytes() const {
+    return peak_bytes_.load(std::memory_order_relaxed);
+}
+
+void MemoryAccount::ResetPeak() {
+    peak_bytes_.store(CurrentBytes(), std::memory_order_relaxed);
+}
+
+size_t MemoryAccount::CurrentBytes(Types type) const {
+    return std::max<int64_t>(
+        bytes_by_type_[static_cast<size_t>(type)].load(std::memory_order_relaxed), 0);
+}
+
+size_t MemoryAccount::CurrentObjects(Types type) const {
+    return std::max<int64_t>(
+        objects_by_type_[static_cast<size_t>(type)].load(std::memory_order_relaxed), 0);
+}
+
+int64_t MemoryAccount::Apply(const Batch& batch) {
+    for (size_t i = 0; i < kTypesCount; ++i) {
+        if (batch.objects_by_type[i] || batch.bytes_by_type[i]) {
+            bytes_by_type_[i].fetch_add(batch.bytes_by_type[i], std::memory_order_relaxed);
+            objects_by_type_[i].fetch_add(batch.objects_by_type[i], std::memory_order_relaxed);
+        }
+    }
+    return bytes_.fetch_add(batch.bytes, std::memory_order_relaxed) + batch.bytes - kOwnerBias;
+}
+
+void MemoryAccount::UpdatePeak(int64_t usage) {
+    if (usage <= 0) {
+        return;
+    }
+    auto total = static_cast<size_t>(usage);
+    auto peak = peak_bytes_.load(std::memory_order_relaxed);
+    while (total > peak &&
+           !peak_bytes_.compare_exchange_weak(peak, total, std::memory_order_relaxed)) {
+    }
+}
+
+bool MemoryAccount::NearLimit(int64_t pending) const {
+    auto usage = Usage() + pending;
+    if (hard_limit_ && usage > static_cast<int64_t>(hard_limit_)) {
+        return true;
+    }
+    return soft_limit_ && usage > static_cast<int64_t>(soft_limit_) &&
+           !over_soft_limit_.load(std::memory_order_relaxed);
+}
+
+void MemoryAccount::FlushPending() {
+    auto account = pending_.account;
+    if (!account) {
+        return;
+    }
+    auto usage = account->Apply(pending_);
+    pending_ = Batch();
+    account->UpdatePeak(usage);
+}
+
+void MemoryAccount::Charge(size_t bytes, Types type) {
+    if (pending_.account != this) {
+        FlushPending();
+        pending_.account = this;
+    }
+    auto index = static_cast<size_t>(type);
+    pending_.bytes += bytes;
+    pending_.bytes_by_type[index] += bytes;
+    ++pending_.objects_by_type[index];
+    if (pending_.bytes >= kChargeBatchBytes ||
+        ((hard_limit_ || soft_limit_) && NearLimit(pending_.bytes))) {
+        ChargeSlow(bytes, type);
+    }
+}
+
+// Applies the batch, which ends with this charge, and checks the limits against the result.
+void MemoryAccount::ChargeSlow(size_t bytes, Types type) {
+    auto index = static_cast<size_t>(type);
+    auto signed_bytes = static_cast<int64_t>(bytes);
+    auto usage = Apply(pending_);
+    pending_ = Batch();
+    if (hard_limit_ && usage > static_cast<int64_t>(hard_limit_)) {
+        bytes_by_type_[index].fetch_sub(signed_bytes, std::memory_order_relaxed);
+        objects_by_type_[index].fetch_sub(1, std::memory_order_relaxed);
+        bytes_.fetch_sub(signed_bytes, std::memory_order_relaxed);
+        throw MemoryLimitError(hard_limit_, bytes);
+    }
+
+    UpdatePeak(usage);
+
+    if (soft_limit_ && usage > static_cast<int64_t>(soft_limit_) &&
+        !over_soft_limit_.exchange(true, std::memory_order_relaxed) && soft_limit_callback_) {
+        try {
+            soft_limit_callback_(*this);
+        } catch (...) {
+            Release(bytes, type);
+            throw;
+        }
+    }
+}
+
+void MemoryAccount::Release(size_t bytes, Types type) {
+    auto index = static_cast<size_t>(type);
+    auto signed_bytes = static_cast<int64_t>(bytes);
+    if (pending_.account == this) {
+        pending_.bytes -= signed_bytes;
+        pending_.bytes_by_type[index] -= signed_bytes;
+        --pending_.objects_by_type[index];
+        if (soft_limit_ && Usage() + pending_.bytes <= static_cast<int64_t>(soft_limit_)) {
+            over_soft_limit_.store(false, std::memory_order_relaxed);
+        }
+        return;
+    }
+    bytes_by_type_[index].fetch_sub(signed_bytes, std::memory_order_relaxed);
+    objects_by_type_[index].fetch_sub(1, std::memory_order_relaxed);
+    if (Usage() - signed_bytes <= static_cast<int64_t>(soft_limit_)) {
+        over_soft_limit_.store(false, std::memory_order_relaxed);
+    }
+    // The account may be gone after this.
+    ReleaseBytes(signed_bytes);
+}
+
+MemoryScope::MemoryScope(std::shared_ptr<MemoryAccount> account)
+    : account_(std::move(account)), previous_(current_account) {
+    current_account = account_.get();
+}
+
+MemoryScope::~MemoryScope() {
+    // The batch may hold charges to account_, which can't outlive the scope's reference.
+    MemoryAccount::FlushPending();
+    current_account = previous_;
+}
+
+MemoryAccount* MemoryScope::Current() {
+    return current_account;
+}
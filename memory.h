@@ -0,0 +1,189 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include "metrics.h"
+#include "parser.h"
+
+struct MemoryLimitError : public std::runtime_error {
+    MemoryLimitError(size_t limit, size_t requested);
+};
+
+// Live bytes and objects allocated through MakeObject on behalf of one interpreter. Objects
+// may be freed on any thread, so the counters are atomic; reading them is O(1). A thread inside
+// a MemoryScope batches its charges and releases in plain thread-local counters and applies
+// them once they reach kChargeBatchBytes, when a limit may be crossed, and when the scope ends.
+// Readings may lag by up to a batch per allocating thread, and the limits are exact only while
+// one thread allocates: each of the others may take its usage over by up to a batch.
+class MemoryAccount {
+public:
+    typedef std::function<void(const MemoryAccount&)> SoftLimitCallback;
+
+    // The account is freed once the returned pointer and every object charged to it are gone.
+    static std::shared_ptr<MemoryAccount> Create();
+
+    MemoryAccount(const MemoryAccount&) = delete;
+
+    MemoryAccount& operator=(const MemoryAccount&) = delete;
+
+    // 0 disables the limit. The callback runs on the allocating thread each time usage
+    // goes over the soft limit; it may throw to abort the evaluation.
+    void SetSoftLimit(size_t bytes, SoftLimitCallback callback);
+
+    // Allocations that would go over the hard limit throw MemoryLimitError. 0 disables it.
+    void SetHardLimit(size_t bytes);
+
+    size_t CurrentBytes() const;
+
+    size_t PeakBytes() const;
+
+    void ResetPeak();
+
+    size_t CurrentBytes(Types type) const;
+
+    size_t CurrentObjects(Types type) const;
+
+    void Charge(size_t bytes, Types type);
+
+    void Release(size_t bytes, Types type);
+
+    // Applies this thread's batch to its account.
+    static void FlushPending();
+
+private:
+    struct Batch;
+
+    MemoryAccount() = default;
+
+    // Usage as the atomic counters see it. An object freed on another thread before the
+    // allocating thread applied its charge makes this low, even negative, until it does.
+    int64_t Usage() const;
+
+    // Returns the usage after applying batch.
+    int64_t Apply(const Batch& batch);
+
+    // Whether the batch brings usage over a limit that hasn't been reported yet.
+    bool NearLimit(int64_t pending) const;
+
+    void ChargeSlow(size_t bytes, Types type);
+
+    void UpdatePeak(int64_t usage);
+
+    void ReleaseBytes(int64_t bytes);
+
+    // Dwarfs any batch, so that the dips described at Usage can't bring bytes_ to zero.
+    static const int64_t kOwnerBias = int64_t(1) << 62;
+
+    static thread_local Batch pending_;
+
+    // Live bytes plus kOwnerBias while the owner's pointer exists, so that whoever brings it to
+    // zero frees the account.
+    std::atomic<int64_t> bytes_{kOwnerBias};
+    std::atomic<size_t> peak_bytes_{0};
+    std::atomic<int64_t> bytes_by_type_[kTypesCount] = {};
+    std::atomic<int64_t> objects_by_type_[kTypesCount] = {};
+    size_t soft_limit_ = 0;
+    size_t hard_limit_ = 0;
+    SoftLimitCallback soft_limit_callback_;
+    std::atomic<bool> over_soft_limit_{false};
+};
+
+// Makes MakeObject on this thread charge account (or nothing, if it is null) until the
+// scope ends.
+class MemoryScope {
+public:
+    explicit MemoryScope(std::shared_ptr<MemoryAccount> account);
+
+    MemoryScope(const MemoryScope&) = delete;
+
+    MemoryScope& operator=(const MemoryScope&) = delete;
+
+    ~MemoryScope();
+
+    static MemoryAccount* Current();
+
+private:
+    std::shared_ptr<MemoryAccount> account_;
+    MemoryAccount* previous_;
+};
+
+// Types an object made by MakeObject<T> is accounted under.
+template <class T>
+constexpr Types kTypeOf = Types::tType;
+
+template <>
+constexpr Types kTypeOf<Cell> = Types::cellType;
+
+template <>
+constexpr Types kTypeOf<Number> = Types::numberType;
+
+template <>
+constexpr Types kTypeOf<Symbol> = Types::symbolType;
+
+// Charges the control block and the object together, since allocate_shared puts them in
+// one allocation. Each charge keeps the account alive, so copies of the allocator stored in
+// control blocks don't have to, and the type is a template argument so that they stay one
+// pointer wide.
+template <class T, Types kType>
+class AccountingAllocator {
+public:
+    typedef T value_type;
+
+    template <class U>
+    struct rebind {
+        typedef AccountingAllocator<U, kType> other;
+    };
+
+    explicit AccountingAllocator(MemoryAccount* account) : account_(account) {
+    }
+
+    template <class U>
+    AccountingAllocator(const AccountingAllocator<U, kType>& other) : account_(other.account_) {
+    }
+
+    T* allocate(size_t n) {
+        account_->Charge(n * sizeof(T), kType);
+        try {
+            return std::allocator<T>().allocate(n);
+        } catch (...) {
+            account_->Release(n * sizeof(T), kType);
+            throw;
+        }
+    }
+
+    void deallocate(T* ptr, size_t n) {
+        std::allocator<T>().deallocate(ptr, n);
+        account_->Release(n * sizeof(T), kType);
+    }
+
+    template <class U>
+    bool operator==(const AccountingAllocator<U, kType>& other) const {
+        return account_ == other.account_;
+    }
+
+    template <class U>
+    bool operator!=(const AccountingAllocator<U, kType>& other) const {
+        return account_ != other.account_;
+    }
+
+private:
+    template <class U, Types>
+    friend class AccountingAllocator;
+
+    MemoryAccount* account_;
+};
+
+// std::make_shared that charges the current thread's MemoryScope, if there is one.
+template <class T, class... Args>
+std::shared_ptr<T> MakeObject(Args&&... args) {
+    auto account = MemoryScope::Current();
+    if (!account) {
+        return std::make_shared<T>(std::forward<Args>(args)...);
+    }
+    return std::allocate_shared<T>(AccountingAllocator<T, kTypeOf<T>>(account),
+                                   std::forward<Args>(args)...);
+}
@@ -0,0 +1,124 @@
+#include "metrics.h"
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+namespace metrics {
+
+namespace {
+
+struct Registry {
+    std::mutex mutex;
+    std::vector<ThreadMetrics*> threads;
+    // Counters of the threads that have already exited.
+    MetricsSnapshot retired;
+};
+
+// Never destroyed, since threads may still exit after static destructors have run.
+Registry& GetRegistry() {
+    static Registry* registry = new Registry();
+    return *registry;
+}
+
+void AddTo(const ThreadMetrics& metrics, MetricsSnapshot* snapshot) {
+    snapshot->eval_calls += metrics.eval_calls.Get();
+    snapshot->lookup_hits += metrics.lookup_hits.Get();
+    snapshot->lookup_misses += metrics.lookup_misses.Get();
+    for (size_t i = 0; i < kBuiltinsCount; ++i) {
+        snapshot->builtin_calls[i] += metrics.builtin_calls[i].Get();
+        snapshot->builtin_nanoseconds[i] += metrics.builtin_nanoseconds[i].Get();
+    }
+    for (size_t i = 0; i < kTypesCount; ++i) {
+        snapshot->allocations[i] += metrics.allocations[i].Get();
+    }
+    snapshot->max_eval_depth = std::max(snapshot->max_eval_depth, metrics.max_eval_depth.Get());
+    snapshot->tokenizer_bytes += metrics.tokenizer_bytes.Get();
+    snapshot->reader_forms += metrics.reader_forms.Get();
+}
+
+struct ThreadRegistration {
+    ThreadRegistration() {
+        auto& registry = GetRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.threads.push_back(&metrics);
+    }
+
+    ~ThreadRegistration() {
+        auto& registry = GetRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        AddTo(metrics, &registry.retired);
+        registry.threads.erase(
+            std::find(registry.threads.begin(), registry.threads.end(), &metrics));
+        local_metrics = nullptr;
+    }
+
+    ThreadMetrics metrics;
+};
+
+}  // namespace
+
+ThreadMetrics* RegisterThread() {
+    thread_local ThreadRegistration registration;
+    return &registration.metrics;
+}
+
+}  // namespace metrics
+
+MetricsSnapshot CollectMetrics() {
+    auto& registry = metrics::GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    MetricsSnapshot snapshot = registry.retired;
+    for (const auto* thread : registry.threads) {
+        metrics::AddTo(*thread, &snapshot);
+    }
+    return snapshot;
+}
+
+namespace {
+
+const char* kBuiltinNames[kBuiltinsCount] = {"+", "-", "*", "/", "if", "quote"};
+
+const char* kTypeNames[kTypesCount] = {"object", "cell", "number", "symbol", "quote", "dot"};
+
+void PrintHeader(const char* name, const char* type, const char* help, std::ostream* out) {
+    *out << "# HELP " << name << ' ' << help << "\n# TYPE " << name << ' ' << type << "\n";
+}
+
+}  // namespace
+
+void PrintPrometheus(const MetricsSnapshot& snapshot, std::ostream* out) {
+    PrintHeader("scheme_eval_calls_total", "counter", "Cell::Eval calls.", out);
+    *out << "scheme_eval_calls_total " << snapshot.eval_calls << "\n";
+
+    PrintHeader("scheme_lookups_total", "counter", "Scope lookups by result.", out);
+    *out << "scheme_lookups_total{result=\"hit\"} " << snapshot.lookup_hits << "\n";
+    *out << "scheme_lookups_total{result=\"miss\"} " << snapshot.lookup_misses << "\n";
+
+    PrintHeader("scheme_builtin_calls_total", "counter", "Builtin Apply calls.", out);
+    for (size_t i = 0; i < kBuiltinsCount; ++i) {
+        *out << "scheme_builtin_calls_total{builtin=\"" << kBuiltinNames[i] << "\"} "
+             << snapshot.builtin_calls[i] << "\n";
+    }
+
+    PrintHeader("scheme_builtin_seconds_total", "counter",
+                "Time spent in builtin Apply, including nested evaluation.", out);
+    for (size_t i = 0; i < kBuiltinsCount; ++i) {
+        *out << "scheme_builtin_seconds_total{builtin=\"" << kBuiltinNames[i] << "\"} "
+             << snapshot.builtin_nanoseconds[i] / 1e9 << "\n";
+    }
+
+    PrintHeader("scheme_objects_allocated_total", "counter", "Objects created by type.", out);
+    for (size_t i = 0; i < kTypesCount; ++i) {
+        *out << "scheme_objects_allocated_total{type=\"" << kTypeNames[i] << "\"} "
+             << snapshot.allocations[i] << "\n";
+    }
+
+    PrintHeader("scheme_eval_depth_max", "gauge", "Deepest Cell::Eval recursion seen.", out);
+    *out << "scheme_eval_depth_max " << snapshot.max_eval_depth << "\n";
+
+    PrintHeader("scheme_tokenizer_bytes_total", "counter", "Bytes consumed by Tokenizer.", out);
+    *out << "scheme_tokenizer_bytes_total " << snapshot.tokenizer_bytes << "\n";
+
+    PrintHeader("scheme_reader_forms_total", "counter", "Top-level forms read.", out);
+    *out << "scheme_reader_forms_total " << snapshot.reader_forms << "\n";
+}
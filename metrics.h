@@ -0,0 +1,138 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+
+// Runtime counters for the interpreter. The hooks below compile to nothing unless the build
+// defines SCHEME_METRICS. Every thread writes to its own counters, and CollectMetrics merges
+// them only when a snapshot is requested.
+
+enum class Builtins {
+    plusBuiltin,
+    minusBuiltin,
+    multiplyBuiltin,
+    divideBuiltin,
+    ifBuiltin,
+    quoteBuiltin
+};
+
+const size_t kBuiltinsCount = 6;
+
+// Number of values in the Types enum from parser.h.
+const size_t kTypesCount = 6;
+
+struct MetricsSnapshot {
+    uint64_t eval_calls = 0;
+    uint64_t lookup_hits = 0;
+    uint64_t lookup_misses = 0;
+    uint64_t builtin_calls[kBuiltinsCount] = {};
+    // Sampled, see kBuiltinTimingPeriod. Inclusive, so the time of `if` covers the branch
+    // it evaluates.
+    uint64_t builtin_nanoseconds[kBuiltinsCount] = {};
+    uint64_t allocations[kTypesCount] = {};
+    uint64_t max_eval_depth = 0;
+    uint64_t tokenizer_bytes = 0;
+    uint64_t reader_forms = 0;
+};
+
+MetricsSnapshot CollectMetrics();
+
+// Prometheus text exposition format. Rates (bytes/s, forms/s) are left to the scraper.
+void PrintPrometheus(const MetricsSnapshot& snapshot, std::ostream* out);
+
+namespace metrics {
+
+// Only the owning thread writes a counter, so a relaxed load and store is enough and
+// avoids a locked read-modify-write.
+class Counter {
+public:
+    void Add(uint64_t value) {
+        value_.store(value_.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    void SetMax(uint64_t value) {
+        if (value > value_.load(std::memory_order_relaxed)) {
+            value_.store(value, std::memory_order_relaxed);
+        }
+    }
+
+    uint64_t Get() const {
+        return value_.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> value_{0};
+};
+
+struct ThreadMetrics {
+    Counter eval_calls;
+    Counter lookup_hits;
+    Counter lookup_misses;
+    Counter builtin_calls[kBuiltinsCount];
+    Counter builtin_nanoseconds[kBuiltinsCount];
+    Counter allocations[kTypesCount];
+    Counter max_eval_depth;
+    Counter tokenizer_bytes;
+    Counter reader_forms;
+};
+
+ThreadMetrics* RegisterThread();
+
+// Inline, so that other translation units reach it directly instead of through a TLS wrapper.
+inline thread_local ThreadMetrics* local_metrics = nullptr;
+
+inline ThreadMetrics& Local() {
+    if (!local_metrics) {
+        local_metrics = RegisterThread();
+    }
+    return *local_metrics;
+}
+
+// Reading the clock costs about as much as a small builtin, so only every
+// kBuiltinTimingPeriod-th call of each builtin is timed and its time is scaled up.
+const uint64_t kBuiltinTimingPeriod = 16;
+
+// A builtin may suspend inside an Evaluation and finish on another thread, so the destructor
+// looks up that thread's counters again instead of keeping the ones it started with.
+class BuiltinScope {
+public:
+    explicit BuiltinScope(Builtins builtin) : index_(static_cast<size_t>(builtin)) {
+        auto& calls = Local().builtin_calls[index_];
+        timed_ = calls.Get() % kBuiltinTimingPeriod == 0;
+        calls.Add(1);
+        if (timed_) {
+            start_ = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~BuiltinScope() {
+        if (timed_) {
+            auto elapsed = std::chrono::steady_clock::now() - start_;
+            Local().builtin_nanoseconds[index_].Add(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() *
+                kBuiltinTimingPeriod);
+        }
+    }
+
+private:
+    size_t index_;
+    bool timed_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace metrics
+
+#ifdef SCHEME_METRICS
+#define SCHEME_METRICS_ADD(counter, value) ::metrics::Local().counter.Add(value)
+#define SCHEME_METRICS_ALLOCATION(type) \
+    ::metrics::Local().allocations[static_cast<size_t>(type)].Add(1)
+#define SCHEME_METRICS_BUILTIN(builtin) \
+    ::metrics::BuiltinScope scheme_metrics_builtin_scope(builtin)
+#else
+#define SCHEME_METRICS_ADD(counter, value) ((void)0)
+#define SCHEME_METRICS_ALLOCATION(type) ((void)0)
+#define SCHEME_METRICS_BUILTIN(builtin) ((void)0)
+#endif
@@ -1,17 +1,49 @@
 #include <parser.h>
 #include <iostream>
+#include <limits>
 #include "scheme.h"
+#include "evaluation.h"
+#include "metrics.h"
+#include "profiler.h"
+#include "lazy.h"
+#include "memory.h"
 
 class Object;
 
+namespace {
+
+thread_local size_t read_depth = 0;
+
+// Evaluates an argument, rejecting the empty list instead of dereferencing it.
+std::shared_ptr<Object> EvalArgument(const std::shared_ptr<Object>& argument,
+                                     const std::shared_ptr<Scope>& scope) {
+    if (!argument) {
+        throw std::runtime_error("can't evaluate ()");
+    }
+    return argument->Eval(scope);
+}
+
+std::shared_ptr<Number> NumberArgument(const std::shared_ptr<Object>& argument,
+                                       const char* name) {
+    auto number = std::dynamic_pointer_cast<Number>(argument);
+    if (!number) {
+        throw std::runtime_error{std::string(name) + " arguments must be numbers"};
+    }
+    return number;
+}
+
+}  // namespace
+
 NameError::NameError(const std::string& name) : std::runtime_error("variable not found: " + name) {
 }
 
 std::shared_ptr<Object> Scope::Lookup(const std::string& name) {
     auto it = variables_.find(name);
     if (it == variables_.end()) {
+        SCHEME_METRICS_ADD(lookup_misses, 1);
         throw NameError(name);
     }
+    SCHEME_METRICS_ADD(lookup_hits, 1);
     return it->second;
 }
 
@@ -26,9 +58,51 @@ bool Object::IsFalse() {
 Object::~Object() = default;
 
 Cell::Cell() : head_(nullptr), tail_(nullptr) {
+    SCHEME_METRICS_ALLOCATION(Types::cellType);
 }
 
 Cell::Cell(std::shared_ptr<Object> head, std::shared_ptr<Object> tail) : head_(head), tail_(tail) {
+    SCHEME_METRICS_ALLOCATION(Types::cellType);
+}
+
+Cell::Cell(std::shared_ptr<LazySpan> span) : head_(span), tail_(nullptr), pending_(true) {
+    SCHEME_METRICS_ALLOCATION(Types::cellType);
+}
+
+namespace {
+
+bool IsLastCellReference(const std::shared_ptr<Object>& obj) {
+    return obj && obj.use_count() == 1 && obj->ID() == Types::cellType;
+}
+
+}  // namespace
+
+Cell::~Cell() {
+    if (!IsLastCellReference(head_) && !IsLastCellReference(tail_)) {
+        return;
+    }
+    std::vector<std::shared_ptr<Object>> cells;
+    cells.push_back(std::move(head_));
+    cells.push_back(std::move(tail_));
+    while (!cells.empty()) {
+        auto object = std::move(cells.back());
+        cells.pop_back();
+        if (IsLastCellReference(object)) {
+            auto cell = static_cast<Cell*>(object.get());
+            cells.push_back(std::move(cell->head_));
+            cells.push_back(std::move(cell->tail_));
+        }
+    }
+}
+
+void Cell::Materialize() const {
+    if (!pending_) {
+        return;
+    }
+    auto list = std::static_pointer_cast<LazySpan>(head_)->Materialize();
+    head_ = list->head_;
+    tail_ = list->tail_;
+    pending_ = false;
 }
 
 Types Cell::ID() const {
@@ -36,6 +110,7 @@ Types Cell::ID() const {
 }
 
 void Cell::PrintTo(std::ostream* out) {
+    Materialize();
     *out << '(';
     ::PrintTo(head_, out);
     auto next = AsCell(tail_);
@@ -45,11 +120,11 @@ void Cell::PrintTo(std::ostream* out) {
     } else {
         while (next) {
             *out << " ";
-            ::PrintTo(next->head_, out);
-            auto next_obj = AsCell(next->tail_);
-            if (!next_obj && next->tail_) {
+            ::PrintTo(next->GetFirst(), out);
+            auto next_obj = AsCell(next->GetSecond());
+            if (!next_obj && next->GetSecond()) {
                 *out << " . ";
-                ::PrintTo(next->tail_, out);
+                ::PrintTo(next->GetSecond(), out);
             }
             next = next_obj;
         }
@@ -59,18 +134,23 @@ void Cell::PrintTo(std::ostream* out) {
 }
 
 std::shared_ptr<Object> Cell::Eval(std::shared_ptr<Scope> scope) {
-    auto ptr = head_->Eval(scope);
+    EvalDepthScope depth_scope;
+    profiler::FrameScope profile_frame(this);
+    EvalStep();
+    Materialize();
+    auto ptr = EvalArgument(head_, scope);
     auto fn = std::dynamic_pointer_cast<Function>(ptr);
     auto sf = std::dynamic_pointer_cast<SpecialForm>(ptr);
     if (!fn && !sf) {
         throw std::runtime_error("first element of the list must be a function");
     }
-    std::vector<std::shared_ptr<Object>> args = ToVector(tail_);
+    std::vector<std::shared_ptr<Object>> args = ToVector(tail_, scope);
     if (fn) {
         for (auto& arg : args) {
-            arg = arg->Eval(scope);
+            arg = EvalArgument(arg, scope);
         }
     }
+    EvalStep();
     if (fn) {
         return fn->Apply(scope, args);
     } else {
@@ -79,24 +159,34 @@ std::shared_ptr<Object> Cell::Eval(std::shared_ptr<Scope> scope) {
 }
 
 const std::shared_ptr<Object>& Cell::GetFirst() const {
+    Materialize();
     return head_;
 }
 
 void Cell::SetFirst(std::shared_ptr<Object> object) {
+    Materialize();
     head_ = object;
 }
 
 const std::shared_ptr<Object>& Cell::GetSecond() const {
+    Materialize();
     return tail_;
 }
 
 void Cell::SetSecond(std::shared_ptr<Object> object) {
+    Materialize();
     tail_ = object;
 }
 
+const LazySpan* Cell::GetPendingSpan() const {
+    return pending_ ? static_cast<const LazySpan*>(head_.get()) : nullptr;
+}
+
 Number::Number() : value_(0) {
+    SCHEME_METRICS_ALLOCATION(Types::numberType);
 }
 Number::Number(int64_t value) : value_(value) {
+    SCHEME_METRICS_ALLOCATION(Types::numberType);
 }
 
 Types Number::ID() const {
@@ -120,9 +210,11 @@ int64_t& Number::SetValue() {
 }
 
 Symbol::Symbol() : name_("") {
+    SCHEME_METRICS_ALLOCATION(Types::symbolType);
 }
 
 Symbol::Symbol(std::string name) : name_(name) {
+    SCHEME_METRICS_ALLOCATION(Types::symbolType);
 }
 
 Types Symbol::ID() const {
@@ -149,8 +241,9 @@ Types Quote::ID() const {
     return Types::quoteType;
 }
 
-std::shared_ptr<Object> Quote::Apply(const std::shared_ptr<Scope>,
+std::shared_ptr<Object> Quote::Apply(const std::shared_ptr<Scope>&,
                                      const std::vector<std::shared_ptr<Object>>& args) {
+    SCHEME_METRICS_BUILTIN(Builtins::quoteBuiltin);
     if (args.size() != 1) {
         throw std::runtime_error("Syntax error!");  // FIXME
     }
@@ -161,24 +254,25 @@ Types Dot::ID() const {
     return Types::dotType;
 }
 
+void Function::PrintTo(std::ostream* out) {
+    *out << "#<function>";
+}
+
 std::shared_ptr<Object> Function::Eval(std::shared_ptr<Scope>) {
     throw std::runtime_error("can't eval function");
 }
 
-std::shared_ptr<Object> Function::Apply(const std::shared_ptr<Scope>& scope,
-                                        const std::vector<std::shared_ptr<Object>>& args) {
+void SpecialForm::PrintTo(std::ostream* out) {
+    *out << "#<special form>";
 }
 
 std::shared_ptr<Object> SpecialForm::Eval(std::shared_ptr<Scope>) {
     throw std::runtime_error("can't eval function");
 }
 
-std::shared_ptr<Object> SpecialForm::Apply(const std::shared_ptr<Scope>& scope,
-                                           const std::vector<std::shared_ptr<Object>>& args) {
-}
-
-std::shared_ptr<Object> Plus::Apply(const std::shared_ptr<Scope>,
+std::shared_ptr<Object> Plus::Apply(const std::shared_ptr<Scope>&,
                                     const std::vector<std::shared_ptr<Object>>& args) {
+    SCHEME_METRICS_BUILTIN(Builtins::plusBuiltin);
     int64_t value = 0;
     for (const auto& arg : args) {
         auto number = std::dynamic_pointer_cast<Number>(arg);
@@ -187,49 +281,45 @@ std::shared_ptr<Object> Plus::Apply(const std::shared_ptr<Scope>,
         }
         value += number->GetValue();
     }
-    return std::make_shared<Number>(value);
+    return MakeObject<Number>(value);
 }
 
-std::shared_ptr<Object> Minus::Apply(const std::shared_ptr<Scope>,
+std::shared_ptr<Object> Minus::Apply(const std::shared_ptr<Scope>&,
                                      const std::vector<std::shared_ptr<Object>>& args) {
+    SCHEME_METRICS_BUILTIN(Builtins::minusBuiltin);
     if (args.size() == 0) {
         throw std::runtime_error("Wrongs number of arguments!");
     }
-    int64_t value = std::dynamic_pointer_cast<Number>(args[0])->GetValue();
-    if (!value) {
-        throw std::runtime_error{"- arguments must be numbers"};
-    }
+    int64_t value = NumberArgument(args[0], "-")->GetValue();
     for (size_t i = 1; i < args.size(); ++i) {
-        auto number = std::dynamic_pointer_cast<Number>(args[i]);
-        if (!number) {
-            throw std::runtime_error{"- arguments must be numbers"};
-        }
-        value -= number->GetValue();
+        value -= NumberArgument(args[i], "-")->GetValue();
     }
-    return std::make_shared<Number>(value);
+    return MakeObject<Number>(value);
 }
 
-std::shared_ptr<Object> Divide::Apply(const std::shared_ptr<Scope>,
+std::shared_ptr<Object> Divide::Apply(const std::shared_ptr<Scope>&,
                                       const std::vector<std::shared_ptr<Object>>& args) {
+    SCHEME_METRICS_BUILTIN(Builtins::divideBuiltin);
     if (args.size() == 0) {
         throw std::runtime_error("Wrongs number of arguments!");
     }
-    int64_t value = std::dynamic_pointer_cast<Number>(args[0])->GetValue();
-    if (!value) {
-        throw std::runtime_error{"- arguments must be numbers"};
-    }
+    int64_t value = NumberArgument(args[0], "/")->GetValue();
     for (size_t i = 1; i < args.size(); ++i) {
-        auto number = std::dynamic_pointer_cast<Number>(args[i]);
-        if (!number) {
-            throw std::runtime_error{"/ arguments must be numbers"};
+        int64_t divisor = NumberArgument(args[i], "/")->GetValue();
+        if (divisor == 0) {
+            throw std::runtime_error{"division by zero"};
         }
-        value /= number->GetValue();
+        if (divisor == -1 && value == std::numeric_limits<int64_t>::min()) {
+            throw std::runtime_error{"/ overflows"};
+        }
+        value /= divisor;
     }
-    return std::make_shared<Number>(value);
+    return MakeObject<Number>(value);
 }
 
-std::shared_ptr<Object> Multiply::Apply(const std::shared_ptr<Scope>,
+std::shared_ptr<Object> Multiply::Apply(const std::shared_ptr<Scope>&,
                                         const std::vector<std::shared_ptr<Object>>& args) {
+    SCHEME_METRICS_BUILTIN(Builtins::multiplyBuiltin);
     int64_t value = 1;
     for (const auto& arg : args) {
         auto number = std::dynamic_pointer_cast<Number>(arg);
@@ -238,30 +328,42 @@ std::shared_ptr<Object> Multiply::Apply(const std::shared_ptr<Scope>,
         }
         value *= number->GetValue();
     }
-    return std::make_shared<Number>(value);
+    return MakeObject<Number>(value);
 }
 
-std::shared_ptr<Object> If::Apply(const std::shared_ptr<Scope> scope,
+std::shared_ptr<Object> If::Apply(const std::shared_ptr<Scope>& scope,
                                   const std::vector<std::shared_ptr<Object>>& args) {
-    auto condition = args[0];  // FIXME
-    auto if_true = args[1];
-    auto if_false = args[2];
-    auto result = condition->Eval(scope);
+    SCHEME_METRICS_BUILTIN(Builtins::ifBuiltin);
+    if (args.size() != 2 && args.size() != 3) {
+        throw SyntaxError("if needs a condition, a branch and an optional else branch");
+    }
+    auto result = EvalArgument(args[0], scope);
     if (result && !result->IsFalse()) {
-        return if_true->Eval(scope);
-    } else {
-        return if_false->Eval(scope);
+        return EvalArgument(args[1], scope);
+    } else if (args.size() == 3) {
+        return EvalArgument(args[2], scope);
     }
-    /*if (args.size() != 3) {
-        throw std::runtime_error("Syntax error!");  // FIXME
-    }*/
+    return nullptr;
 }
 
 SyntaxError::SyntaxError(const std::string& what) : std::runtime_error(what) {
 }
 
+ReadDepthScope::ReadDepthScope() {
+    if (read_depth == kMaxReadDepth) {
+        throw SyntaxError("Too deeply nested");
+    }
+    // Lazy spans are parsed while evaluating, on an Evaluation's smaller stack.
+    CheckEvalStack();
+    ++read_depth;
+}
+
+ReadDepthScope::~ReadDepthScope() {
+    --read_depth;
+}
+
 bool IsNumber(const std::shared_ptr<Object>& obj) {
-    return Types::numberType == obj.get()->ID();
+    return obj && Types::numberType == obj->ID();
 }
 
 std::shared_ptr<Number> AsNumber(const std::shared_ptr<Object>& obj) {
@@ -272,7 +374,7 @@ std::shared_ptr<Number> AsNumber(const std::shared_ptr<Object>& obj) {
 }
 
 bool IsCell(const std::shared_ptr<Object>& obj) {
-    return Types::cellType == obj->ID();
+    return obj && Types::cellType == obj->ID();
 }
 
 std::shared_ptr<Cell> AsCell(const std::shared_ptr<Object>& obj) {
@@ -283,7 +385,7 @@ std::shared_ptr<Cell> AsCell(const std::shared_ptr<Object>& obj) {
 }
 
 bool IsSymbol(const std::shared_ptr<Object>& obj) {
-    return Types::symbolType == obj->ID();
+    return obj && Types::symbolType == obj->ID();
 }
 
 std::shared_ptr<Symbol> AsSymbol(const std::shared_ptr<Object>& obj) {
@@ -297,18 +399,23 @@ std::shared_ptr<Object> Read(Tokenizer* tokenizer) {
     if (tokenizer->IsEnd()) {
         return nullptr;
     }
+    // Calls nested through ReadList are parts of a form, not forms.
+    if (read_depth == 0) {
+        SCHEME_METRICS_ADD(reader_forms, 1);
+    }
+    ReadDepthScope depth_scope;
     auto current_object = tokenizer->GetToken();
     if (SymbolToken* symbol = std::get_if<SymbolToken>(&current_object)) {
         tokenizer->Next();
-        return std::make_shared<Symbol>(symbol->name);
+        return MakeObject<Symbol>(symbol->name);
     } else if (ConstantToken* constant = std::get_if<ConstantToken>(&current_object)) {
         tokenizer->Next();
-        return std::make_shared<Number>(constant->value);
+        return MakeObject<Number>(constant->value);
     } else if (std::holds_alternative<QuoteToken>(current_object)) {
         tokenizer->Next();
-        auto new_cell = std::make_shared<Cell>(Cell());
-        new_cell->SetFirst(std::make_shared<Symbol>("quote"));
-        new_cell->SetSecond(Read(tokenizer));
+        auto new_cell = MakeObject<Cell>();
+        new_cell->SetFirst(MakeObject<Symbol>("quote"));
+        new_cell->SetSecond(MakeObject<Cell>(Read(tokenizer), nullptr));
         return new_cell;
     } else if (std::holds_alternative<DotToken>(current_object)) {
         throw SyntaxError("Unexpected symbol");
@@ -346,7 +453,7 @@ std::shared_ptr<Object> ReadList(Tokenizer* tokenizer) {
             }
         } else {
             auto current_object = Read(tokenizer);
-            auto new_cell = std::make_shared<Cell>(Cell());
+            auto new_cell = MakeObject<Cell>();
             new_cell->SetFirst(current_object);
             if (head == nullptr) {
                 head = new_cell;
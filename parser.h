@@ -9,6 +9,8 @@ enum class Types { tType, cellType, numberType, symbolType, quoteType, dotType }
 
 class Object;
 
+class LazySpan;
+
 class NameError : public std::runtime_error {
 public:
     NameError(const std::string& name);
@@ -40,6 +42,13 @@ public:
 
     Cell(std::shared_ptr<Object> head, std::shared_ptr<Object> tail);
 
+    // A list that is parsed from source the first time it is touched.
+    explicit Cell(std::shared_ptr<LazySpan> span);
+
+    // Frees the cells it solely owns iteratively, so that long or deep lists can't overflow
+    // the stack.
+    virtual ~Cell() override;
+
     virtual Types ID() const override;
 
     virtual void PrintTo(std::ostream* out) override;
@@ -54,9 +63,16 @@ public:
 
     void SetSecond(std::shared_ptr<Object> object);
 
+    // The source of a lazily read list that hasn't been parsed yet, or null.
+    const LazySpan* GetPendingSpan() const;
+
 private:
-    std::shared_ptr<Object> head_;
-    std::shared_ptr<Object> tail_;
+    void Materialize() const;
+
+    // While pending_ is set, head_ holds the LazySpan and tail_ is empty.
+    mutable std::shared_ptr<Object> head_;
+    mutable std::shared_ptr<Object> tail_;
+    mutable bool pending_ = false;
 };
 
 class Number : public Object {
@@ -99,72 +115,92 @@ private:
     std::string name_;
 };
 
-class Quote : public SpecialForm {
-public:
-    virtual Types ID() const override;
-
-    virtual std::shared_ptr<Object> Apply(const std::shared_ptr<Scope>,
-                                          const std::vector<std::shared_ptr<Object>>& args);
-};
-
 class Dot : public Object {
     virtual Types ID() const override;
 };
 
 class Function : public Object {
 public:
+    virtual void PrintTo(std::ostream* out) override;
+
     virtual std::shared_ptr<Object> Eval(std::shared_ptr<Scope>) override;
 
     virtual std::shared_ptr<Object> Apply(const std::shared_ptr<Scope>& scope,
-                                          const std::vector<std::shared_ptr<Object>>& args);
+                                          const std::vector<std::shared_ptr<Object>>& args) = 0;
 
 private:
 };
 
 class SpecialForm : public Object {
 public:
+    virtual void PrintTo(std::ostream* out) override;
+
     virtual std::shared_ptr<Object> Eval(std::shared_ptr<Scope>) override;
 
     virtual std::shared_ptr<Object> Apply(const std::shared_ptr<Scope>& scope,
-                                          const std::vector<std::shared_ptr<Object>>& args);
+                                          const std::vector<std::shared_ptr<Object>>& args) = 0;
 
 private:
 };
 
+class Quote : public SpecialForm {
+public:
+    virtual Types ID() const override;
+
+    virtual std::shared_ptr<Object> Apply(
+        const std::shared_ptr<Scope>&, const std::vector<std::shared_ptr<Object>>& args) override;
+};
+
 class Plus : public Function {
 public:
     virtual std::shared_ptr<Object> Apply(
-        const std::shared_ptr<Scope>, const std::vector<std::shared_ptr<Object>>& args) override;
+        const std::shared_ptr<Scope>&, const std::vector<std::shared_ptr<Object>>& args) override;
 };
 
 class Minus : public Function {
 public:
     virtual std::shared_ptr<Object> Apply(
-        const std::shared_ptr<Scope>, const std::vector<std::shared_ptr<Object>>& args) override;
+        const std::shared_ptr<Scope>&, const std::vector<std::shared_ptr<Object>>& args) override;
 };
 
 class Multiply : public Function {
 public:
     virtual std::shared_ptr<Object> Apply(
-        const std::shared_ptr<Scope>, const std::vector<std::shared_ptr<Object>>& args) override;
+        const std::shared_ptr<Scope>&, const std::vector<std::shared_ptr<Object>>& args) override;
 };
 
 class Divide : public Function {
 public:
     virtual std::shared_ptr<Object> Apply(
-        const std::shared_ptr<Scope>, const std::vector<std::shared_ptr<Object>>& args) override;
+        const std::shared_ptr<Scope>&, const std::vector<std::shared_ptr<Object>>& args) override;
 };
 
 class If : public SpecialForm {
 public:
     virtual std::shared_ptr<Object> Apply(
-        const std::shared_ptr<Scope>, const std::vector<std::shared_ptr<Object>>& args) override;
+        const std::shared_ptr<Scope>&, const std::vector<std::shared_ptr<Object>>& args) override;
 };
 
 struct SyntaxError : public std::runtime_error {
     explicit SyntaxError(const std::string& what);
 };
 
+// Deepest nesting of lists and quotes that Read accepts, so that hostile input can't exhaust
+// the stack of the reading thread.
+const size_t kMaxReadDepth = 4096;
+
+// Counts Read recursion on the current thread and throws SyntaxError past kMaxReadDepth.
+class ReadDepthScope {
+public:
+    ReadDepthScope();
+
+    ReadDepthScope(const ReadDepthScope&) = delete;
+
+    ReadDepthScope& operator=(const ReadDepthScope&) = delete;
+
+    ~ReadDepthScope();
+};
+
 bool IsNumber(const std::shared_ptr<Object>& obj);
 
 std::shared_ptr<Number> AsNumber(const std::shared_ptr<Object>& obj);
@@ -0,0 +1,204 @@
+#include "profiler.h"
+#include <algorithm>
+#include <cctype>
+#include <iomanip>
+#include <set>
+#include <sstream>
+#include "lazy.h"
+#include "parser.h"
+
+namespace profiler {
+
+thread_local ShadowStack shadow_stack;
+
+void TakeSample() {
+    shadow_stack.countdown = shadow_stack.profiler->sample_period_;
+    shadow_stack.profiler->Sample(shadow_stack.frames);
+}
+
+void SwapFrames(std::vector<const Cell*>* frames) {
+    shadow_stack.frames.swap(*frames);
+}
+
+}  // namespace profiler
+
+namespace {
+
+const size_t kMaxLabelLength = 60;
+
+// Prints obj like PrintTo, but stops once label is longer than kMaxLabelLength and shows lazily
+// read lists by their source, so labeling a frame neither walks nor parses the whole form.
+void AppendForm(Object* obj, std::string* label) {
+    if (label->size() > kMaxLabelLength) {
+        return;
+    }
+    if (!obj) {
+        *label += "()";
+        return;
+    }
+    if (obj->ID() != Types::cellType) {
+        std::stringstream text;
+        obj->PrintTo(&text);
+        *label += text.str();
+        return;
+    }
+    auto cell = static_cast<Cell*>(obj);
+    if (auto span = cell->GetPendingSpan()) {
+        label->append(span->Source().substr(0, kMaxLabelLength + 1 - label->size()));
+        return;
+    }
+    *label += '(';
+    AppendForm(cell->GetFirst().get(), label);
+    auto tail = cell->GetSecond().get();
+    while (tail && label->size() <= kMaxLabelLength) {
+        if (tail->ID() != Types::cellType) {
+            *label += " . ";
+            AppendForm(tail, label);
+            break;
+        }
+        *label += ' ';
+        AppendForm(static_cast<Cell*>(tail)->GetFirst().get(), label);
+        tail = static_cast<Cell*>(tail)->GetSecond().get();
+    }
+    *label += ')';
+}
+
+// The symbol a form printed by AppendForm starts with, or "?" if it starts with a number, a
+// list or a quote. Works on the source of unparsed lists too, so naming a frame never parses.
+std::string HeadName(const std::string& text) {
+    auto begin = text.find_first_not_of(' ', 1);
+    if (begin == std::string::npos) {
+        return "?";
+    }
+    auto first = static_cast<unsigned char>(text[begin]);
+    auto second = begin + 1 < text.size() ? static_cast<unsigned char>(text[begin + 1]) : ' ';
+    if (isdigit(first) || (first == '-' && isdigit(second))) {
+        return "?";
+    }
+    if (first == '+' || first == '-' || first == '*') {
+        return std::string(1, first);
+    }
+    if (!isalpha(first) && first != '?' && first != '!') {
+        return "?";
+    }
+    return text.substr(begin, text.find_first_of(" ()'.+*", begin) - begin);
+}
+
+}  // namespace
+
+Profiler::Profiler(size_t sample_period) : sample_period_(std::max<size_t>(1, sample_period)) {
+}
+
+Profiler::~Profiler() {
+    Stop();
+}
+
+void Profiler::Start() {
+    profiler::shadow_stack.profiler = this;
+    profiler::shadow_stack.countdown = sample_period_;
+    profiler::shadow_stack.frames.clear();
+    last_sample_ = std::chrono::steady_clock::now();
+    running_ = true;
+}
+
+void Profiler::Stop() {
+    if (running_ && profiler::shadow_stack.profiler == this) {
+        profiler::shadow_stack.profiler = nullptr;
+        profiler::shadow_stack.frames.clear();
+    }
+    running_ = false;
+}
+
+size_t Profiler::SampleCount() const {
+    return sample_count_;
+}
+
+void Profiler::Sample(const std::vector<const Cell*>& frames) {
+    auto now = std::chrono::steady_clock::now();
+    auto& stats = stacks_[frames];
+    ++stats.samples;
+    stats.time += now - last_sample_;
+    last_sample_ = now;
+    ++sample_count_;
+    for (const auto* frame : frames) {
+        Label(frame);
+    }
+}
+
+const std::string& Profiler::Label(const Cell* frame) {
+    auto it = frames_.find(frame);
+    if (it != frames_.end()) {
+        return it->second.label;
+    }
+    // The frame may not be parsed yet: Cell::Eval pushes it before materializing it.
+    std::string text;
+    AppendForm(const_cast<Cell*>(frame), &text);
+    auto head = HeadName(text);
+    if (text.size() > kMaxLabelLength) {
+        text = text.substr(0, kMaxLabelLength) + "...";
+    }
+    FrameInfo info{frame->weak_from_this().lock(), head + " " + text};
+    return frames_.emplace(frame, info).first->second.label;
+}
+
+void Profiler::PrintFolded(std::ostream* out) const {
+    for (const auto& [frames, stats] : stacks_) {
+        for (size_t i = 0; i < frames.size(); ++i) {
+            if (i != 0) {
+                *out << ';';
+            }
+            *out << frames_.at(frames[i]).label;
+        }
+        if (frames.empty()) {
+            *out << "<top>";
+        }
+        *out << ' ' << stats.samples << "\n";
+    }
+}
+
+void Profiler::PrintTable(std::ostream* out) const {
+    struct Row {
+        const Cell* frame = nullptr;
+        size_t self_samples = 0;
+        size_t total_samples = 0;
+        std::chrono::nanoseconds self_time{0};
+        std::chrono::nanoseconds total_time{0};
+    };
+    std::unordered_map<const Cell*, Row> rows;
+    for (const auto& [frames, stats] : stacks_) {
+        if (frames.empty()) {
+            continue;
+        }
+        auto& leaf = rows[frames.back()];
+        leaf.self_samples += stats.samples;
+        leaf.self_time += stats.time;
+        // Recursive forms appear several times in one stack but count once.
+        std::set<const Cell*> seen(frames.begin(), frames.end());
+        for (const auto* frame : seen) {
+            auto& row = rows[frame];
+            row.frame = frame;
+            row.total_samples += stats.samples;
+            row.total_time += stats.time;
+        }
+    }
+    std::vector<Row> sorted;
+    for (const auto& [frame, row] : rows) {
+        sorted.push_back(row);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const Row& lhs, const Row& rhs) {
+        return lhs.total_time > rhs.total_time;
+    });
+    auto to_ms = [](std::chrono::nanoseconds time) { return time.count() / 1e6; };
+    auto flags = out->flags();
+    auto precision = out->precision();
+    *out << std::right << std::setw(10) << "self ms" << std::setw(10) << "total ms"
+         << std::setw(10) << "self #" << std::setw(10) << "total #" << "  form\n";
+    for (const auto& row : sorted) {
+        *out << std::fixed << std::setprecision(3) << std::setw(10) << to_ms(row.self_time)
+             << std::setw(10) << to_ms(row.total_time) << std::setw(10) << row.self_samples
+             << std::setw(10) << row.total_samples << "  " << frames_.at(row.frame).label
+             << "\n";
+    }
+    out->flags(flags);
+    out->precision(precision);
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Object;
+class Cell;
+class Profiler;
+
+namespace profiler {
+
+// Scheme-level call stack of the current thread, only maintained while a Profiler is
+// running on it.
+struct ShadowStack {
+    Profiler* profiler = nullptr;
+    std::vector<const Cell*> frames;
+    size_t countdown = 0;
+};
+
+extern thread_local ShadowStack shadow_stack;
+
+void TakeSample();
+
+// Pushes the form for the duration of its Cell::Eval.
+class FrameScope {
+public:
+    explicit FrameScope(const Cell* form) : pushed_(shadow_stack.profiler != nullptr) {
+        if (pushed_) {
+            shadow_stack.frames.push_back(form);
+            if (--shadow_stack.countdown == 0) {
+                // The destructor doesn't run if this throws, and the frame may be freed by
+                // the time the next sample reads the stack.
+                try {
+                    TakeSample();
+                } catch (...) {
+                    shadow_stack.frames.pop_back();
+                    throw;
+                }
+            }
+        }
+    }
+
+    ~FrameScope() {
+        if (pushed_ && !shadow_stack.frames.empty()) {
+            shadow_stack.frames.pop_back();
+        }
+    }
+
+private:
+    bool pushed_;
+};
+
+// Exchanges the thread's frames with *frames; used by Evaluation to keep its own stack.
+void SwapFrames(std::vector<const Cell*>* frames);
+
+}  // namespace profiler
+
+// Step-count sampling profiler. Once started on a thread, every sample_period-th Cell::Eval
+// records the Scheme call stack, weighted by the time elapsed since the previous sample.
+class Profiler {
+public:
+    explicit Profiler(size_t sample_period = 1000);
+
+    Profiler(const Profiler&) = delete;
+
+    Profiler& operator=(const Profiler&) = delete;
+
+    ~Profiler();
+
+    void Start();
+
+    void Stop();
+
+    size_t SampleCount() const;
+
+    // One "frame;frame;frame count" line per distinct stack, for flamegraph tools.
+    void PrintFolded(std::ostream* out) const;
+
+    // Self and total samples and time per form, sorted by total time.
+    void PrintTable(std::ostream* out) const;
+
+private:
+    friend void profiler::TakeSample();
+
+    struct StackStats {
+        size_t samples = 0;
+        std::chrono::nanoseconds time{0};
+    };
+
+    struct FrameInfo {
+        // Keeps the form alive so its address can't be reused for another form.
+        std::shared_ptr<const Object> form;
+        std::string label;
+    };
+
+    void Sample(const std::vector<const Cell*>& frames);
+
+    const std::string& Label(const Cell* frame);
+
+    size_t sample_period_;
+    bool running_ = false;
+    std::chrono::steady_clock::time_point last_sample_;
+    std::map<std::vector<const Cell*>, StackStats> stacks_;
+    std::unordered_map<const Cell*, FrameInfo> frames_;
+    size_t sample_count_ = 0;
+};
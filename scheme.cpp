@@ -1,7 +1,8 @@
 #include "scheme.h"
 #include "parser.h"
 
-SchemeInterpretor::SchemeInterpretor() : global_scope_(std::make_shared<Scope>()) {
+SchemeInterpretor::SchemeInterpretor()
+    : global_scope_(std::make_shared<Scope>()), memory_(MemoryAccount::Create()) {
     global_scope_->variables_["+"] = std::make_shared<Plus>();
     global_scope_->variables_["-"] = std::make_shared<Minus>();
     global_scope_->variables_["*"] = std::make_shared<Multiply>();
@@ -9,6 +10,7 @@ SchemeInterpretor::SchemeInterpretor() : global_scope_(std::make_shared<Scope>()
     global_scope_->variables_["if"] = std::make_shared<If>();
     global_scope_->variables_["quote"] = std::make_shared<Quote>();
     // builtint scope
+    Checkpoint();
 }
 
 SchemeInterpretor::~SchemeInterpretor() {
@@ -16,10 +18,36 @@ SchemeInterpretor::~SchemeInterpretor() {
 }
 
 std::shared_ptr<Object> SchemeInterpretor::Eval(std::shared_ptr<Object> in) {
+    MemoryScope memory_scope(memory_);
     return in->Eval(global_scope_);
 }
 
-inline void PrintTo(const std::shared_ptr<Object>& obj, std::ostream* out) {
+std::shared_ptr<Object> SchemeInterpretor::Read(Tokenizer* tokenizer) {
+    MemoryScope memory_scope(memory_);
+    return ::Read(tokenizer);
+}
+
+std::shared_ptr<Evaluation> SchemeInterpretor::Start(std::shared_ptr<Object> in) {
+    return std::make_shared<Evaluation>(in, global_scope_, memory_);
+}
+
+void SchemeInterpretor::Checkpoint() {
+    checkpoint_ = global_scope_->variables_;
+}
+
+void SchemeInterpretor::Rollback() {
+    global_scope_->variables_ = checkpoint_;
+}
+
+MetricsSnapshot SchemeInterpretor::Stats() const {
+    return CollectMetrics();
+}
+
+const std::shared_ptr<MemoryAccount>& SchemeInterpretor::GetMemoryAccount() const {
+    return memory_;
+}
+
+void PrintTo(const std::shared_ptr<Object>& obj, std::ostream* out) {
     if (!obj) {
         *out << "()";
         return;
@@ -27,26 +55,26 @@ inline void PrintTo(const std::shared_ptr<Object>& obj, std::ostream* out) {
     obj->PrintTo(out);
 }
 
-inline std::string Print(const std::shared_ptr<Object>& obj) {
+std::string Print(const std::shared_ptr<Object>& obj) {
     std::stringstream ss;
     PrintTo(obj, &ss);
     return ss.str();
 }
 
 std::vector<std::shared_ptr<Object>> ToVector(const std::shared_ptr<Object>& head,
-                                              std::shared_ptr<Scope> scope) {
+                                              std::shared_ptr<Scope>) {
     std::vector<std::shared_ptr<Object>> elements;
     if (!head) {
         return elements;
     } else {
         auto current = AsCell(head);
         while (current != nullptr) {
-            elements.push_back(current->GetFirst()->Eval(scope));
+            elements.push_back(current->GetFirst());
             auto next = current->GetSecond();
             if (!IsCell(next) && next) {
                 throw std::runtime_error("wrong argument list");
             }
-            current = next;
+            current = AsCell(next);
         }
     }
     return elements;
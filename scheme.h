@@ -3,6 +3,10 @@
 #include <memory>
 #include <string>
 #include "parser.h"
+#include "evaluation.h"
+#include "metrics.h"
+#include "profiler.h"
+#include "memory.h"
 #include <functional>
 #include <sstream>
 
@@ -17,10 +21,28 @@ public:
 
     std::shared_ptr<Object> Eval(std::shared_ptr<Object> in);
 
+    // Same as ::Read, but the objects are charged to this interpreter's memory account.
+    std::shared_ptr<Object> Read(Tokenizer* tokenizer);
+
+    std::shared_ptr<Evaluation> Start(std::shared_ptr<Object> in);
+
+    // Remembers the global bindings, so that Rollback can undo whatever is evaluated later.
+    void Checkpoint();
+
+    void Rollback();
+
+    // Process-wide: counters are shared by every interpreter in the process.
+    MetricsSnapshot Stats() const;
+
+    // Objects allocated while reading and evaluating through this interpreter.
+    const std::shared_ptr<MemoryAccount>& GetMemoryAccount() const;
+
 private:
     std::shared_ptr<Scope> global_scope_;
+    std::unordered_map<std::string, std::shared_ptr<Object>> checkpoint_;
+    std::shared_ptr<MemoryAccount> memory_;
 };
 
-inline void PrintTo(const std::shared_ptr<Object>& obj, std::ostream* out);
+void PrintTo(const std::shared_ptr<Object>& obj, std::ostream* out);
 
-inline std::string Print(const std::shared_ptr<Object>& obj);
+std::string Print(const std::shared_ptr<Object>& obj);
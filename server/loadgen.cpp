@@ -0,0 +1,218 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "protocol.h"
+
+extern char** environ;
+
+namespace {
+
+struct Options {
+    std::string socket_path = "/tmp/scheme.sock";
+    // When set, every request spawns "<exec_path> --eval" instead of using the socket.
+    std::string exec_path;
+    std::string prelude_path;
+    std::string expression = "(+ 1 (* 2 3) (- 10 (+ 4 5)) (if 1 (* 6 7) 0))";
+    size_t connections = 4;
+    size_t requests = 10000;
+};
+
+struct Outcome {
+    bool ok = false;
+    std::string response;
+};
+
+int Connect(const std::string& path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        return -1;
+    }
+    std::strcpy(address.sun_path, path.c_str());
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 && connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+Outcome RequestOverSocket(int fd, const std::string& expression) {
+    Outcome outcome;
+    if (WriteFrame(fd, expression) && ReadFrame(fd, &outcome.response)) {
+        outcome.ok = !outcome.response.empty() && outcome.response[0] == kResponseOk;
+    }
+    return outcome;
+}
+
+Outcome RequestOverProcess(const Options& options) {
+    Outcome outcome;
+    int to_child[2];
+    int from_child[2];
+    if (pipe2(to_child, O_CLOEXEC) < 0) {
+        return outcome;
+    }
+    if (pipe2(from_child, O_CLOEXEC) < 0) {
+        close(to_child[0]);
+        close(to_child[1]);
+        return outcome;
+    }
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, to_child[0], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, from_child[1], STDOUT_FILENO);
+
+    std::vector<std::string> args = {options.exec_path, "--eval"};
+    if (!options.prelude_path.empty()) {
+        args.push_back("--prelude");
+        args.push_back(options.prelude_path);
+    }
+    std::vector<char*> argv;
+    for (auto& arg : args) {
+        argv.push_back(&arg[0]);
+    }
+    argv.push_back(nullptr);
+
+    pid_t pid;
+    int spawned = posix_spawn(&pid, options.exec_path.c_str(), &actions, nullptr, argv.data(),
+                              environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(to_child[0]);
+    close(from_child[1]);
+    if (spawned == 0) {
+        WriteAll(to_child[1], options.expression.data(), options.expression.size());
+        close(to_child[1]);
+        char buffer[4096];
+        ssize_t got;
+        while ((got = read(from_child[0], buffer, sizeof(buffer))) > 0 ||
+               (got < 0 && errno == EINTR)) {
+            if (got > 0) {
+                outcome.response.append(buffer, got);
+            }
+        }
+        int status = 0;
+        waitpid(pid, &status, 0);
+        outcome.ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    } else {
+        close(to_child[1]);
+    }
+    close(from_child[0]);
+    return outcome;
+}
+
+double Percentile(const std::vector<double>& sorted, double fraction) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    auto index = static_cast<size_t>(fraction * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+void Usage(const char* name) {
+    std::cerr << "usage: " << name
+              << " [--socket PATH | --exec SERVER_BINARY [--prelude FILE]]\n"
+                 "       [--connections N] [--requests N] [--expr EXPRESSION]\n";
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            Usage(argv[0]);
+            return 2;
+        }
+        std::string value = argv[++i];
+        if (arg == "--socket") {
+            options.socket_path = value;
+        } else if (arg == "--exec") {
+            options.exec_path = value;
+        } else if (arg == "--prelude") {
+            options.prelude_path = value;
+        } else if (arg == "--connections") {
+            options.connections = std::max<size_t>(1, std::stoull(value));
+        } else if (arg == "--requests") {
+            options.requests = std::stoull(value);
+        } else if (arg == "--expr") {
+            options.expression = value;
+        } else {
+            Usage(argv[0]);
+            return 2;
+        }
+    }
+
+    std::atomic<size_t> next_request{0};
+    std::atomic<size_t> errors{0};
+    std::mutex latencies_mutex;
+    std::vector<double> latencies;
+    std::string sample_response;
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> clients;
+    for (size_t c = 0; c < options.connections; ++c) {
+        clients.emplace_back([&] {
+            int fd = -1;
+            if (options.exec_path.empty()) {
+                fd = Connect(options.socket_path);
+                if (fd < 0) {
+                    std::cerr << "can't connect to " << options.socket_path << "\n";
+                    return;
+                }
+            }
+            std::vector<double> local;
+            Outcome outcome;
+            while (next_request.fetch_add(1) < options.requests) {
+                auto sent = std::chrono::steady_clock::now();
+                outcome = fd >= 0 ? RequestOverSocket(fd, options.expression)
+                                  : RequestOverProcess(options);
+                std::chrono::duration<double, std::micro> elapsed =
+                    std::chrono::steady_clock::now() - sent;
+                local.push_back(elapsed.count());
+                if (!outcome.ok) {
+                    ++errors;
+                }
+            }
+            if (fd >= 0) {
+                close(fd);
+            }
+            std::lock_guard<std::mutex> lock(latencies_mutex);
+            latencies.insert(latencies.end(), local.begin(), local.end());
+            if (sample_response.empty()) {
+                sample_response = outcome.response;
+            }
+        });
+    }
+    for (auto& client : clients) {
+        client.join();
+    }
+    std::chrono::duration<double> wall = std::chrono::steady_clock::now() - start;
+
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << (options.exec_path.empty() ? "mode: socket " + options.socket_path
+                                            : "mode: process per request " + options.exec_path)
+              << "\nrequests: " << latencies.size() << "  errors: " << errors.load()
+              << "  connections: " << options.connections << "\nresponse: " << sample_response
+              << std::fixed << std::setprecision(1)
+              << "\nthroughput: " << latencies.size() / wall.count() << " req/s"
+              << "\nlatency us: p50 " << Percentile(latencies, 0.50) << "  p90 "
+              << Percentile(latencies, 0.90) << "  p99 " << Percentile(latencies, 0.99)
+              << "  max " << (latencies.empty() ? 0 : latencies.back()) << "\n";
+    return errors.load() == 0 ? 0 : 1;
+}
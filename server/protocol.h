@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unistd.h>
+
+// Every message is a 4-byte big-endian length followed by that many bytes. A request is the
+// source text to evaluate. A response starts with kResponseOk and the printed result, or with
+// kResponseError and the error message.
+
+const char kResponseOk = '+';
+const char kResponseError = '-';
+
+const size_t kFrameHeaderSize = 4;
+const uint32_t kMaxFrameSize = 16 << 20;
+
+inline std::string EncodeFrame(const std::string& payload) {
+    auto size = static_cast<uint32_t>(payload.size());
+    std::string frame;
+    frame.reserve(kFrameHeaderSize + payload.size());
+    frame += static_cast<char>(size >> 24);
+    frame += static_cast<char>(size >> 16);
+    frame += static_cast<char>(size >> 8);
+    frame += static_cast<char>(size);
+    frame += payload;
+    return frame;
+}
+
+inline uint32_t DecodeFrameSize(const char* header) {
+    auto bytes = reinterpret_cast<const unsigned char*>(header);
+    return (uint32_t(bytes[0]) << 24) | (uint32_t(bytes[1]) << 16) | (uint32_t(bytes[2]) << 8) |
+           uint32_t(bytes[3]);
+}
+
+// Blocking helpers for clients.
+
+inline bool WriteAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        auto written = write(fd, data, size);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+inline bool ReadAll(int fd, char* data, size_t size) {
+    while (size > 0) {
+        auto got = read(fd, data, size);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return false;
+        }
+        data += got;
+        size -= got;
+    }
+    return true;
+}
+
+inline bool WriteFrame(int fd, const std::string& payload) {
+    auto frame = EncodeFrame(payload);
+    return WriteAll(fd, frame.data(), frame.size());
+}
+
+inline bool ReadFrame(int fd, std::string* payload) {
+    char header[kFrameHeaderSize];
+    if (!ReadAll(fd, header, kFrameHeaderSize)) {
+        return false;
+    }
+    auto size = DecodeFrameSize(header);
+    if (size > kMaxFrameSize) {
+        return false;
+    }
+    payload->resize(size);
+    return ReadAll(fd, &(*payload)[0], size);
+}
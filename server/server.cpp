@@ -0,0 +1,528 @@
+#include <cctype>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "protocol.h"
+#include "scheme.h"
+
+namespace {
+
+struct Options {
+    std::string socket_path = "/tmp/scheme.sock";
+    std::string prelude_path;
+    size_t workers = std::max(1u, std::thread::hardware_concurrency());
+    // 0 means no limit.
+    size_t max_steps = 0;
+    size_t memory_limit = 0;
+    bool eval_once = false;
+};
+
+std::string ReadStream(std::istream* in) {
+    return std::string(std::istreambuf_iterator<char>(*in), std::istreambuf_iterator<char>());
+}
+
+std::string ReadFile(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error("can't open " + path);
+    }
+    return ReadStream(&in);
+}
+
+// Tokenizer only knows spaces and stops making progress on characters it doesn't handle, so
+// requests are checked up front instead of hanging a worker.
+std::string CheckSource(std::string source) {
+    for (auto& c : source) {
+        if (c == '\n' || c == '\r' || c == '\t') {
+            c = ' ';
+        } else if (!isalnum(static_cast<unsigned char>(c)) &&
+                   std::string(" ()'.?!+-*").find(c) == std::string::npos) {
+            throw SyntaxError(std::string("unsupported character '") + c + "'");
+        }
+    }
+    return source;
+}
+
+// Evaluates every form in source and returns the last result.
+std::shared_ptr<Object> EvaluateSource(SchemeInterpretor* interpretor, const std::string& source,
+                                       size_t max_steps) {
+    std::stringstream in(CheckSource(source));
+    Tokenizer tokenizer(&in);
+    std::shared_ptr<Object> result;
+    while (!tokenizer.IsEnd()) {
+        auto form = interpretor->Read(&tokenizer);
+        if (!form) {
+            result = nullptr;
+        } else if (max_steps == 0) {
+            result = interpretor->Eval(form);
+        } else {
+            auto evaluation = interpretor->Start(form);
+            if (!evaluation->Resume(max_steps)) {
+                throw std::runtime_error("step limit exceeded");
+            }
+            result = evaluation->GetResult();
+        }
+    }
+    return result;
+}
+
+std::string Respond(SchemeInterpretor* interpretor, const std::string& request,
+                    size_t max_steps) {
+    std::string response;
+    try {
+        std::stringstream out;
+        out << kResponseOk;
+        PrintTo(EvaluateSource(interpretor, request, max_steps), &out);
+        response = out.str();
+    } catch (const std::exception& e) {
+        response = std::string(1, kResponseError) + e.what();
+    }
+    return response;
+}
+
+std::unique_ptr<SchemeInterpretor> MakeInterpretor(const std::string& prelude,
+                                                   size_t memory_limit) {
+    auto interpretor = std::make_unique<SchemeInterpretor>();
+    EvaluateSource(interpretor.get(), prelude, 0);
+    interpretor->Checkpoint();
+    interpretor->GetMemoryAccount()->SetHardLimit(memory_limit);
+    return interpretor;
+}
+
+void CheckSystemCall(int result, const char* what) {
+    if (result < 0) {
+        throw std::runtime_error(std::string(what) + ": " + std::strerror(errno));
+    }
+}
+
+// Accepts requests on a Unix domain socket with an epoll loop on the calling thread and
+// evaluates them on worker threads. Each worker owns an interpreter that has the prelude
+// evaluated; it is rolled back to that state after every request. With --memory-limit, a
+// request whose live objects outgrow the limit fails without affecting the others. Requests on one
+// connection are answered in order, one at a time. A connection stops being read while too many
+// of its requests or responses are queued, and one whose peer has shut down its sending side is
+// closed once everything it sent has been answered.
+class Server {
+public:
+    Server(const Options& options, const std::string& prelude) : options_(options) {
+        for (size_t i = 0; i < options_.workers; ++i) {
+            interpretors_.push_back(MakeInterpretor(prelude, options_.memory_limit));
+        }
+    }
+
+    ~Server() {
+        for (const auto& entry : connections_) {
+            close(entry.second.fd);
+        }
+        for (int fd : {listen_fd_, event_fd_, signal_fd_, epoll_fd_}) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+
+    void Run() {
+        Listen();
+        for (auto& interpretor : interpretors_) {
+            workers_.emplace_back([this, &interpretor] { WorkerLoop(interpretor.get()); });
+        }
+        std::cerr << "listening on " << options_.socket_path << " with " << workers_.size()
+                  << " workers\n";
+        EventLoop();
+        {
+            std::lock_guard<std::mutex> lock(jobs_mutex_);
+            stopping_ = true;
+        }
+        jobs_cv_.notify_all();
+        for (auto& worker : workers_) {
+            worker.join();
+        }
+        unlink(options_.socket_path.c_str());
+    }
+
+private:
+    static const uint64_t kListenId = 0;
+    static const uint64_t kWakeId = 1;
+    static const uint64_t kSignalId = 2;
+
+    // Per connection, so that a client that sends without reading can't grow the server.
+    static const size_t kMaxQueuedRequests = 64;
+    static const size_t kMaxQueuedOutput = 4 << 20;
+    static const size_t kMaxBufferedInput = kFrameHeaderSize + kMaxFrameSize;
+
+    struct Connection {
+        int fd = -1;
+        std::string in;
+        std::string out;
+        std::deque<std::string> requests;
+        bool busy = false;
+        bool peer_open = true;
+        uint32_t watched = 0;
+    };
+
+    struct Job {
+        uint64_t connection;
+        std::string request;
+    };
+
+    void Listen() {
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        // Blocked before the workers start, so that they inherit the mask.
+        CheckSystemCall(pthread_sigmask(SIG_BLOCK, &signals, nullptr), "pthread_sigmask");
+        signal_fd_ = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+        CheckSystemCall(signal_fd_, "signalfd");
+
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (options_.socket_path.size() >= sizeof(address.sun_path)) {
+            throw std::runtime_error("socket path is too long");
+        }
+        std::strcpy(address.sun_path, options_.socket_path.c_str());
+        listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        CheckSystemCall(listen_fd_, "socket");
+        unlink(options_.socket_path.c_str());
+        CheckSystemCall(bind(listen_fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)),
+                        "bind");
+        CheckSystemCall(listen(listen_fd_, SOMAXCONN), "listen");
+
+        event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        CheckSystemCall(event_fd_, "eventfd");
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        CheckSystemCall(epoll_fd_, "epoll_create1");
+        Watch(listen_fd_, kListenId, EPOLLIN, EPOLL_CTL_ADD);
+        Watch(event_fd_, kWakeId, EPOLLIN, EPOLL_CTL_ADD);
+        Watch(signal_fd_, kSignalId, EPOLLIN, EPOLL_CTL_ADD);
+    }
+
+    void Watch(int fd, uint64_t id, uint32_t events, int operation) {
+        epoll_event event{};
+        event.events = events;
+        event.data.u64 = id;
+        CheckSystemCall(epoll_ctl(epoll_fd_, operation, fd, &event), "epoll_ctl");
+    }
+
+    void EventLoop() {
+        epoll_event events[64];
+        while (true) {
+            int count = epoll_wait(epoll_fd_, events, 64, -1);
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            CheckSystemCall(count, "epoll_wait");
+            for (int i = 0; i < count; ++i) {
+                auto id = events[i].data.u64;
+                if (id == kListenId) {
+                    Accept();
+                } else if (id == kWakeId) {
+                    DeliverResponses();
+                } else if (id == kSignalId) {
+                    std::cerr << "shutting down\n";
+                    return;
+                } else {
+                    OnConnectionEvent(id, events[i].events);
+                }
+            }
+        }
+    }
+
+    void Accept() {
+        while (true) {
+            int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) {
+                    continue;
+                }
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    std::cerr << "accept4: " << std::strerror(errno) << "\n";
+                }
+                return;
+            }
+            auto id = next_connection_id_++;
+            auto& connection = connections_[id];
+            connection.fd = fd;
+            connection.watched = EPOLLIN | EPOLLRDHUP;
+            Watch(fd, id, connection.watched, EPOLL_CTL_ADD);
+        }
+    }
+
+    void OnConnectionEvent(uint64_t id, uint32_t events) {
+        auto it = connections_.find(id);
+        if (it == connections_.end()) {
+            return;
+        }
+        auto& connection = it->second;
+        // The peer is gone in both directions, so nothing can be answered any more.
+        if (events & (EPOLLHUP | EPOLLERR)) {
+            Close(id);
+            return;
+        }
+        if ((events & EPOLLOUT) && !Flush(id, &connection)) {
+            return;
+        }
+        if ((events & (EPOLLIN | EPOLLRDHUP)) && !ReadInput(&connection)) {
+            Close(id);
+            return;
+        }
+        Update(id, &connection);
+    }
+
+    // Reads what has arrived, up to kMaxBufferedInput. Returns false on a read error.
+    bool ReadInput(Connection* connection) {
+        char buffer[64 << 10];
+        while (connection->peer_open && connection->in.size() < kMaxBufferedInput) {
+            auto got = read(connection->fd, buffer, sizeof(buffer));
+            if (got > 0) {
+                connection->in.append(buffer, got);
+                continue;
+            }
+            if (got < 0 && errno == EINTR) {
+                continue;
+            }
+            if (got == 0) {
+                connection->peer_open = false;
+                break;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        return true;
+    }
+
+    // Moves complete frames from in to requests while there is room. Returns false on a
+    // malformed frame.
+    bool ParseRequests(Connection* connection) {
+        size_t offset = 0;
+        while (connection->requests.size() < kMaxQueuedRequests &&
+               connection->in.size() - offset >= kFrameHeaderSize) {
+            auto size = DecodeFrameSize(connection->in.data() + offset);
+            if (size > kMaxFrameSize) {
+                return false;
+            }
+            if (connection->in.size() - offset - kFrameHeaderSize < size) {
+                break;
+            }
+            connection->requests.push_back(
+                connection->in.substr(offset + kFrameHeaderSize, size));
+            offset += kFrameHeaderSize + size;
+        }
+        connection->in.erase(0, offset);
+        return true;
+    }
+
+    static bool Backlogged(const Connection& connection) {
+        return connection.requests.size() >= kMaxQueuedRequests ||
+               connection.out.size() >= kMaxQueuedOutput;
+    }
+
+    // Queues what has been read, starts the next request, and watches for input only while the
+    // backlog has room. Closes the connection once a peer that stopped sending has all its
+    // answers. Returns false if the connection was closed.
+    bool Update(uint64_t id, Connection* connection) {
+        if (!ParseRequests(connection)) {
+            Close(id);
+            return false;
+        }
+        Dispatch(id, connection);
+        if (!connection->peer_open && !connection->busy && connection->requests.empty() &&
+            connection->out.empty()) {
+            Close(id);
+            return false;
+        }
+        uint32_t events = 0;
+        if (connection->peer_open && !Backlogged(*connection)) {
+            events |= EPOLLIN | EPOLLRDHUP;
+        }
+        if (!connection->out.empty()) {
+            events |= EPOLLOUT;
+        }
+        if (events != connection->watched) {
+            connection->watched = events;
+            Watch(connection->fd, id, events, EPOLL_CTL_MOD);
+        }
+        return true;
+    }
+
+    void Dispatch(uint64_t id, Connection* connection) {
+        if (connection->busy || connection->requests.empty()) {
+            return;
+        }
+        connection->busy = true;
+        {
+            std::lock_guard<std::mutex> lock(jobs_mutex_);
+            jobs_.push_back(Job{id, std::move(connection->requests.front())});
+        }
+        connection->requests.pop_front();
+        jobs_cv_.notify_one();
+    }
+
+    void DeliverResponses() {
+        uint64_t value;
+        while (read(event_fd_, &value, sizeof(value)) > 0) {
+        }
+        std::vector<std::pair<uint64_t, std::string>> responses;
+        {
+            std::lock_guard<std::mutex> lock(responses_mutex_);
+            responses.swap(responses_);
+        }
+        for (auto& [id, response] : responses) {
+            auto it = connections_.find(id);
+            if (it == connections_.end()) {
+                continue;
+            }
+            auto& connection = it->second;
+            connection.busy = false;
+            connection.out += EncodeFrame(response);
+            if (Flush(id, &connection)) {
+                Update(id, &connection);
+            }
+        }
+    }
+
+    // Returns false if the connection had to be closed.
+    bool Flush(uint64_t id, Connection* connection) {
+        size_t offset = 0;
+        while (offset < connection->out.size()) {
+            auto written = send(connection->fd, connection->out.data() + offset,
+                                connection->out.size() - offset, MSG_NOSIGNAL);
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
+            }
+            if (written < 0) {
+                Close(id);
+                return false;
+            }
+            offset += written;
+        }
+        connection->out.erase(0, offset);
+        return true;
+    }
+
+    // A response still in flight for this connection is dropped when it arrives.
+    void Close(uint64_t id) {
+        auto it = connections_.find(id);
+        close(it->second.fd);
+        connections_.erase(it);
+    }
+
+    void WorkerLoop(SchemeInterpretor* interpretor) {
+        while (true) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(jobs_mutex_);
+                jobs_cv_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+                if (jobs_.empty()) {
+                    return;
+                }
+                job = std::move(jobs_.front());
+                jobs_.pop_front();
+            }
+            auto response = Respond(interpretor, job.request, options_.max_steps);
+            interpretor->Rollback();
+            {
+                std::lock_guard<std::mutex> lock(responses_mutex_);
+                responses_.emplace_back(job.connection, std::move(response));
+            }
+            uint64_t one = 1;
+            while (write(event_fd_, &one, sizeof(one)) < 0 && errno == EINTR) {
+            }
+        }
+    }
+
+    Options options_;
+    std::vector<std::unique_ptr<SchemeInterpretor>> interpretors_;
+    std::vector<std::thread> workers_;
+
+    int listen_fd_ = -1;
+    int event_fd_ = -1;
+    int signal_fd_ = -1;
+    int epoll_fd_ = -1;
+    uint64_t next_connection_id_ = 3;
+    std::unordered_map<uint64_t, Connection> connections_;
+
+    std::mutex jobs_mutex_;
+    std::condition_variable jobs_cv_;
+    std::deque<Job> jobs_;
+    bool stopping_ = false;
+
+    std::mutex responses_mutex_;
+    std::vector<std::pair<uint64_t, std::string>> responses_;
+};
+
+void Usage(const char* name) {
+    std::cerr << "usage: " << name
+              << " [--socket PATH] [--workers N] [--prelude FILE] [--max-steps N]\n"
+                 "       [--memory-limit BYTES] [--eval]\n"
+                 "  --eval evaluates stdin once and exits, for process-per-request use\n";
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--eval") {
+            options.eval_once = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            Usage(argv[0]);
+            return 2;
+        }
+        std::string value = argv[++i];
+        if (arg == "--socket") {
+            options.socket_path = value;
+        } else if (arg == "--workers") {
+            options.workers = std::max<size_t>(1, std::stoull(value));
+        } else if (arg == "--prelude") {
+            options.prelude_path = value;
+        } else if (arg == "--max-steps") {
+            options.max_steps = std::stoull(value);
+        } else if (arg == "--memory-limit") {
+            options.memory_limit = std::stoull(value);
+        } else {
+            Usage(argv[0]);
+            return 2;
+        }
+    }
+
+    try {
+        auto prelude = options.prelude_path.empty() ? "" : ReadFile(options.prelude_path);
+        if (options.eval_once) {
+            auto interpretor = MakeInterpretor(prelude, options.memory_limit);
+            auto response = Respond(interpretor.get(), ReadStream(&std::cin), options.max_steps);
+            std::cout << response << std::flush;
+            return response[0] == kResponseOk ? 0 : 1;
+        }
+        Server server(options, prelude);
+        server.Run();
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
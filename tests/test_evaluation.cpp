@@ -0,0 +1,118 @@
+#include <gtest/gtest.h>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include "evaluation.h"
+#include "parser.h"
+#include "scheme.h"
+#include "tokenizer.h"
+
+namespace {
+
+std::shared_ptr<Object> ReadForm(SchemeInterpretor* interpretor, const std::string& source) {
+    std::stringstream in(source);
+    Tokenizer tokenizer(&in);
+    return interpretor->Read(&tokenizer);
+}
+
+// (+ (+ ... (+ 1))) nested depth times, built directly so that the reader's own limit
+// doesn't get in the way.
+std::shared_ptr<Object> NestedSum(size_t depth) {
+    std::shared_ptr<Object> form = std::make_shared<Number>(1);
+    for (size_t i = 0; i < depth; ++i) {
+        form = std::make_shared<Cell>(std::make_shared<Symbol>("+"),
+                                      std::make_shared<Cell>(form, nullptr));
+    }
+    return form;
+}
+
+}  // namespace
+
+TEST(Evaluation, RunsToCompletion) {
+    SchemeInterpretor interpretor;
+    auto evaluation = interpretor.Start(ReadForm(&interpretor, "(+ 1 (+ 2 (+ 3 4)))"));
+    EXPECT_TRUE(evaluation->Resume(std::numeric_limits<size_t>::max()));
+    EXPECT_EQ("10", Print(evaluation->GetResult()));
+    EXPECT_EQ(6u, evaluation->StepsTaken());
+}
+
+TEST(Evaluation, EverySliceRunsExactlyItsBudget) {
+    SchemeInterpretor interpretor;
+    auto evaluation = interpretor.Start(ReadForm(&interpretor, "(+ 1 (+ 2 (+ 3 4)))"));
+    size_t resumes = 0;
+    while (!evaluation->Resume(1)) {
+        ++resumes;
+        EXPECT_EQ(resumes, evaluation->StepsTaken());
+        EXPECT_THROW(evaluation->GetResult(), std::runtime_error);
+    }
+    EXPECT_EQ(5u, resumes);
+    EXPECT_EQ("10", Print(evaluation->GetResult()));
+}
+
+TEST(Evaluation, ResumeWithZeroStepsMakesNoProgress) {
+    SchemeInterpretor interpretor;
+    auto evaluation = interpretor.Start(ReadForm(&interpretor, "(+ 1 2)"));
+    EXPECT_FALSE(evaluation->Resume(0));
+    EXPECT_FALSE(evaluation->Resume(0));
+    EXPECT_EQ(0u, evaluation->StepsTaken());
+    EXPECT_TRUE(evaluation->Resume(2));
+    EXPECT_EQ("3", Print(evaluation->GetResult()));
+}
+
+TEST(Evaluation, ErrorsAreRethrownByGetResult) {
+    SchemeInterpretor interpretor;
+    auto evaluation = interpretor.Start(ReadForm(&interpretor, "(+ 1 (+ 2 undefined))"));
+    EXPECT_TRUE(evaluation->Resume(std::numeric_limits<size_t>::max()));
+    EXPECT_THROW(evaluation->GetResult(), std::runtime_error);
+}
+
+TEST(Evaluation, DestructorCancelsSuspendedEvaluation) {
+    SchemeInterpretor interpretor;
+    auto form = ReadForm(&interpretor, "(+ 1 (+ 2 (+ 3 4)))");
+    std::weak_ptr<Object> weak_form = form;
+    auto evaluation = interpretor.Start(std::move(form));
+    EXPECT_FALSE(evaluation->Resume(3));
+    evaluation.reset();
+    EXPECT_TRUE(weak_form.expired());
+
+    auto next = interpretor.Start(ReadForm(&interpretor, "(* 2 3)"));
+    EXPECT_TRUE(next->Resume(std::numeric_limits<size_t>::max()));
+    EXPECT_EQ("6", Print(next->GetResult()));
+}
+
+TEST(Evaluation, ResumesOnAnotherThread) {
+    SchemeInterpretor interpretor;
+    auto evaluation = interpretor.Start(ReadForm(&interpretor, "(+ 1 (+ 2 (+ 3 4)))"));
+    EXPECT_FALSE(evaluation->Resume(2));
+    std::thread([&] {
+        EXPECT_FALSE(evaluation->Resume(2));
+    }).join();
+    EXPECT_TRUE(evaluation->Resume(2));
+    EXPECT_EQ("10", Print(evaluation->GetResult()));
+}
+
+TEST(Evaluation, TooDeepFormFailsAndInterpreterRecovers) {
+    SchemeInterpretor interpretor;
+    auto deep = NestedSum(kMaxEvalDepth + 10);
+
+    auto evaluation = interpretor.Start(deep);
+    EXPECT_TRUE(evaluation->Resume(std::numeric_limits<size_t>::max()));
+    EXPECT_THROW(evaluation->GetResult(), EvaluationTooDeep);
+    EXPECT_THROW(interpretor.Eval(deep), EvaluationTooDeep);
+
+    EXPECT_EQ("1", Print(interpretor.Eval(NestedSum(100))));
+    auto next = interpretor.Start(NestedSum(100));
+    EXPECT_TRUE(next->Resume(std::numeric_limits<size_t>::max()));
+    EXPECT_EQ("1", Print(next->GetResult()));
+}
+
+TEST(Evaluation, SmallStackStopsBeforeOverflowing) {
+    auto scope = std::make_shared<Scope>();
+    scope->variables_["+"] = std::make_shared<Plus>();
+    Evaluation evaluation(NestedSum(kMaxEvalDepth - 1), scope, nullptr,
+                          4 * Evaluation::kStackReserve);
+    EXPECT_TRUE(evaluation.Resume(std::numeric_limits<size_t>::max()));
+    EXPECT_THROW(evaluation.GetResult(), EvaluationTooDeep);
+}
@@ -0,0 +1,119 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "bench/corpus.h"
+#include "lazy.h"
+#include "parser.h"
+#include "scheme.h"
+#include "tokenizer.h"
+
+namespace {
+
+const size_t kThresholds[] = {0, 1, 2, 3, 5, 8, 16, 64, 1024, LazyReader::kNoSublists};
+
+std::vector<std::string> ReadEager(const std::string& source) {
+    std::stringstream in(source);
+    Tokenizer tokenizer(&in);
+    std::vector<std::string> forms;
+    while (!tokenizer.IsEnd()) {
+        forms.push_back(Print(Read(&tokenizer)));
+    }
+    return forms;
+}
+
+std::vector<std::string> ReadLazily(const std::string& source, size_t threshold) {
+    LazyReader reader(source, threshold);
+    std::vector<std::string> forms;
+    while (!reader.IsEnd()) {
+        forms.push_back(Print(reader.Read()));
+    }
+    return forms;
+}
+
+}  // namespace
+
+TEST(LazyReader, MatchesEagerReaderOnCorpora) {
+    for (const auto& corpus : MakeAllCorpora(20000, 7)) {
+        auto expected = ReadEager(corpus.text);
+        for (auto threshold : kThresholds) {
+            EXPECT_EQ(expected, ReadLazily(corpus.text, threshold))
+                << corpus.name << ", threshold " << threshold;
+        }
+    }
+}
+
+TEST(LazyReader, MatchesEagerReaderOnEdgeCases) {
+    const char* sources[] = {
+        "()",
+        "( )",
+        "(())",
+        "(a . b)",
+        "(a b . c)",
+        "((a . b) (c . d))",
+        "'x",
+        "'(a 'b)",
+        "(quote (1 2 3))",
+        "(a (b (c (d (e)))) f)",
+        "(  a   (  b  )  )",
+        "1 -2 +3 (- 4) (+ 5 -6)",
+        "(x1 (y2 (z3 (w4 long-symbol-name-here))) (another list with several symbols))",
+    };
+    for (const auto* source : sources) {
+        auto expected = ReadEager(source);
+        for (auto threshold : kThresholds) {
+            EXPECT_EQ(expected, ReadLazily(source, threshold))
+                << source << ", threshold " << threshold;
+        }
+    }
+}
+
+TEST(LazyReader, EvaluatesLikeEagerReader) {
+    auto corpus = MakeArithmeticCorpus(20000, 11);
+    SchemeInterpretor interpretor;
+    std::stringstream in(corpus.text);
+    Tokenizer tokenizer(&in);
+    std::vector<std::string> expected;
+    while (!tokenizer.IsEnd()) {
+        expected.push_back(Print(interpretor.Eval(Read(&tokenizer))));
+    }
+    for (auto threshold : kThresholds) {
+        LazyReader reader(corpus.text, threshold);
+        std::vector<std::string> results;
+        while (!reader.IsEnd()) {
+            results.push_back(Print(interpretor.Eval(reader.Read())));
+        }
+        EXPECT_EQ(expected, results) << "threshold " << threshold;
+    }
+}
+
+TEST(LazyReader, ReportsUnmatchedBrackets) {
+    for (auto threshold : kThresholds) {
+        EXPECT_THROW(ReadLazily("(a (b c)", threshold), SyntaxError) << threshold;
+        EXPECT_THROW(ReadLazily("(a (b (c d) e)", threshold), SyntaxError) << threshold;
+    }
+}
+
+TEST(FindClosingBracket, MatchesNaiveScan) {
+    std::mt19937 random(3);
+    const char alphabet[] = "(()) ab";
+    for (int round = 0; round < 2000; ++round) {
+        std::string text(random() % 200, ' ');
+        for (auto& c : text) {
+            c = alphabet[random() % (sizeof(alphabet) - 1)];
+        }
+        size_t begin = text.empty() ? 0 : random() % text.size();
+        size_t expected = text.size();
+        int depth = 0;
+        for (size_t i = begin; i < text.size(); ++i) {
+            if (text[i] == '(') {
+                ++depth;
+            } else if (text[i] == ')' && depth-- == 0) {
+                expected = i;
+                break;
+            }
+        }
+        EXPECT_EQ(expected, FindClosingBracket(text.data(), begin, text.size())) << text;
+    }
+}
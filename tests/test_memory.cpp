@@ -0,0 +1,122 @@
+#include <gtest/gtest.h>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "memory.h"
+#include "parser.h"
+#include "scheme.h"
+#include "tokenizer.h"
+
+namespace {
+
+std::shared_ptr<Object> ReadForm(SchemeInterpretor* interpretor, const std::string& source) {
+    std::stringstream in(source);
+    Tokenizer tokenizer(&in);
+    return interpretor->Read(&tokenizer);
+}
+
+std::string LongList(size_t length) {
+    std::string source = "(";
+    for (size_t i = 0; i < length; ++i) {
+        source += "x" + std::to_string(i) + " ";
+    }
+    return source + ")";
+}
+
+}  // namespace
+
+TEST(MemoryAccount, CountsLiveObjects) {
+    SchemeInterpretor interpretor;
+    const auto& account = interpretor.GetMemoryAccount();
+    auto before = account->CurrentBytes();
+    {
+        auto form = ReadForm(&interpretor, "(a (1 2) b)");
+        EXPECT_EQ(5u, account->CurrentObjects(Types::cellType));
+        EXPECT_EQ(2u, account->CurrentObjects(Types::numberType));
+        EXPECT_EQ(2u, account->CurrentObjects(Types::symbolType));
+        EXPECT_GT(account->CurrentBytes(), before);
+        EXPECT_GE(account->PeakBytes(), account->CurrentBytes());
+    }
+    EXPECT_EQ(before, account->CurrentBytes());
+    EXPECT_EQ(0u, account->CurrentObjects(Types::cellType));
+}
+
+TEST(MemoryAccount, ObjectFreedOnAnotherThreadBeforeItsChargeIsApplied) {
+    auto account = MemoryAccount::Create();
+    {
+        MemoryScope scope(account);
+        auto number = MakeObject<Number>(1);
+        std::thread([number = std::move(number)]() mutable { number.reset(); }).join();
+        EXPECT_EQ(0u, account->CurrentBytes());
+        EXPECT_EQ(0u, account->CurrentObjects(Types::numberType));
+
+        // Another thread applying its batch meanwhile must see a sane total.
+        account->SetHardLimit(1 << 20);
+        std::thread([&] {
+            MemoryScope other(account);
+            std::vector<std::shared_ptr<Number>> numbers;
+            for (int i = 0; i < 1000; ++i) {
+                numbers.push_back(MakeObject<Number>(i));
+            }
+        }).join();
+    }
+    EXPECT_EQ(0u, account->CurrentBytes());
+    EXPECT_EQ(0u, account->CurrentObjects(Types::numberType));
+    EXPECT_LT(account->PeakBytes(), 1u << 20);
+}
+
+TEST(MemoryAccount, InterpreterUsableAfterHardLimitAbort) {
+    SchemeInterpretor interpretor;
+    const auto& account = interpretor.GetMemoryAccount();
+    auto before = account->CurrentBytes();
+    account->SetHardLimit(before + (64 << 10));
+
+    EXPECT_THROW(ReadForm(&interpretor, LongList(5000)), MemoryLimitError);
+    EXPECT_EQ(before, account->CurrentBytes());
+    EXPECT_EQ(0u, account->CurrentObjects(Types::cellType));
+
+    EXPECT_EQ("3", Print(interpretor.Eval(ReadForm(&interpretor, "(+ 1 2)"))));
+    auto evaluation = interpretor.Start(ReadForm(&interpretor, "(* 2 (+ 1 2))"));
+    EXPECT_TRUE(evaluation->Resume(100));
+    EXPECT_EQ("6", Print(evaluation->GetResult()));
+}
+
+TEST(MemoryAccount, SoftLimitCallbackRearmsOnceUsageDrops) {
+    SchemeInterpretor interpretor;
+    const auto& account = interpretor.GetMemoryAccount();
+    size_t calls = 0;
+    account->SetSoftLimit(account->CurrentBytes() + (64 << 10),
+                          [&](const MemoryAccount&) { ++calls; });
+    {
+        auto first = ReadForm(&interpretor, LongList(2000));
+        EXPECT_EQ(1u, calls);
+        auto second = ReadForm(&interpretor, LongList(2000));
+        EXPECT_EQ(1u, calls);
+    }
+    auto third = ReadForm(&interpretor, LongList(2000));
+    EXPECT_EQ(2u, calls);
+}
+
+TEST(MemoryAccount, ThrowingSoftLimitCallbackAbortsTheRead) {
+    SchemeInterpretor interpretor;
+    const auto& account = interpretor.GetMemoryAccount();
+    auto before = account->CurrentBytes();
+    account->SetSoftLimit(before + (64 << 10), [](const MemoryAccount&) {
+        throw std::runtime_error("over soft limit");
+    });
+    EXPECT_THROW(ReadForm(&interpretor, LongList(5000)), std::runtime_error);
+    EXPECT_EQ(before, account->CurrentBytes());
+    EXPECT_EQ("3", Print(interpretor.Eval(ReadForm(&interpretor, "(+ 1 2)"))));
+}
+
+TEST(MemoryAccount, OutlivesItsInterpreter) {
+    std::shared_ptr<Object> form;
+    {
+        SchemeInterpretor interpretor;
+        form = ReadForm(&interpretor, LongList(100));
+    }
+    EXPECT_EQ(std::string::npos, Print(form).find("x100"));
+    form.reset();
+}
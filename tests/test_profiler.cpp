@@ -0,0 +1,93 @@
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+#include "lazy.h"
+#include "parser.h"
+#include "profiler.h"
+#include "scheme.h"
+#include "tokenizer.h"
+
+namespace {
+
+std::shared_ptr<Object> ReadForm(SchemeInterpretor* interpretor, const std::string& source) {
+    std::stringstream in(source);
+    Tokenizer tokenizer(&in);
+    return interpretor->Read(&tokenizer);
+}
+
+std::string Folded(const Profiler& profiler) {
+    std::stringstream out;
+    profiler.PrintFolded(&out);
+    return out.str();
+}
+
+}  // namespace
+
+TEST(Profiler, LabelsFramesWithHeadAndForm) {
+    SchemeInterpretor interpretor;
+    Profiler profiler(1);
+    profiler.Start();
+    interpretor.Eval(ReadForm(&interpretor, "(+ 1 (* 2 3))"));
+    profiler.Stop();
+    EXPECT_EQ("+ (+ 1 (* 2 3)) 1\n+ (+ 1 (* 2 3));* (* 2 3) 1\n", Folded(profiler));
+}
+
+TEST(Profiler, TruncatesLongLabels) {
+    SchemeInterpretor interpretor;
+    std::string source = "(+";
+    for (int i = 0; i < 100; ++i) {
+        source += " 1";
+    }
+    source += ")";
+    Profiler profiler(1);
+    profiler.Start();
+    interpretor.Eval(ReadForm(&interpretor, source));
+    profiler.Stop();
+    EXPECT_EQ("+ " + source.substr(0, 60) + "... 1\n", Folded(profiler));
+}
+
+TEST(Profiler, LabelingLeavesLazyListsUnparsed) {
+    std::string quoted = "(";
+    for (int i = 0; i < 200; ++i) {
+        quoted += "(x" + std::to_string(i) + " y) ";
+    }
+    quoted += ")";
+    LazyReader reader("(quote " + quoted + ")", 16);
+    auto form = reader.Read();
+
+    SchemeInterpretor interpretor;
+    Profiler profiler(1);
+    profiler.Start();
+    interpretor.Eval(form);
+    profiler.Stop();
+
+    auto argument = AsCell(AsCell(form)->GetSecond())->GetFirst();
+    EXPECT_NE(nullptr, AsCell(argument)->GetPendingSpan());
+    EXPECT_EQ("quote (quote " + quoted.substr(0, 53) + "... 1\n", Folded(profiler));
+}
+
+TEST(Profiler, FailedParseOfSampledFrameLeavesNoStaleFrame) {
+    SchemeInterpretor interpretor;
+    Profiler profiler(1);
+    profiler.Start();
+    LazyReader reader("(+ 1 . 2 3)");
+    EXPECT_THROW(interpretor.Eval(reader.Read()), SyntaxError);
+    EXPECT_TRUE(profiler::shadow_stack.frames.empty());
+    EXPECT_EQ("3", Print(interpretor.Eval(ReadForm(&interpretor, "(+ 1 2)"))));
+    profiler.Stop();
+    EXPECT_NE(std::string::npos, Folded(profiler).find("+ (+ 1 . 2 3) 1\n"));
+}
+
+TEST(Profiler, PrintTableRestoresStreamFormat) {
+    SchemeInterpretor interpretor;
+    Profiler profiler(1);
+    profiler.Start();
+    interpretor.Eval(ReadForm(&interpretor, "(+ 1 2)"));
+    profiler.Stop();
+    std::stringstream out;
+    profiler.PrintTable(&out);
+    std::stringstream after;
+    after.copyfmt(out);
+    after << 0.5;
+    EXPECT_EQ("0.5", after.str());
+}
@@ -4,6 +4,7 @@
 #include <string>
 #include <variant>
 #include <tuple>
+#include "metrics.h"
 
 struct SymbolToken {
     SymbolToken(std::string new_name) : name(new_name) {
@@ -85,7 +86,7 @@ public:
             if (cur == '(') {
                 if (accum_token.empty()) {
                     this_token_ = BracketToken::OPEN;
-                    working_stream_->get();
+                    Advance();
                     break;
                 } else {
                     this_token_ = MakeLongToken(accum_token);
@@ -94,17 +95,17 @@ public:
                 }
             } else if (cur == ' ') {
                 if (accum_token.empty()) {
-                    working_stream_->get();
+                    Advance();
                 } else {
                     this_token_ = MakeLongToken(accum_token);
                     accum_token.clear();
-                    working_stream_->get();
+                    Advance();
                     break;
                 }
             } else if (cur == ')') {
                 if (accum_token.empty()) {
                     this_token_ = BracketToken::CLOSE;
-                    working_stream_->get();
+                    Advance();
                     break;
                 } else {
                     this_token_ = MakeLongToken(accum_token);
@@ -114,7 +115,7 @@ public:
             } else if (cur == '\'') {
                 if (accum_token.empty()) {
                     this_token_ = QuoteToken();
-                    working_stream_->get();
+                    Advance();
                     break;
                 } else {
                     this_token_ = MakeLongToken(accum_token);
@@ -124,7 +125,7 @@ public:
             } else if (cur == '.') {
                 if (accum_token.empty()) {
                     this_token_ = DotToken();
-                    working_stream_->get();
+                    Advance();
                     break;
                 } else {
                     this_token_ = MakeLongToken(accum_token);
@@ -133,11 +134,11 @@ public:
                 }
             } else if (isdigit(cur) || isalpha(cur) || cur == '?' || cur == '!') {
                 accum_token += cur;
-                working_stream_->get();
+                Advance();
             } else if (cur == '+') {
                 if (accum_token.empty()) {
                     this_token_ = SymbolToken("+");
-                    working_stream_->get();
+                    Advance();
                     break;
                 } else {
                     this_token_ = MakeLongToken(accum_token);
@@ -147,7 +148,7 @@ public:
             } else if (cur == '*') {
                 if (accum_token.empty()) {
                     this_token_ = SymbolToken("*");
-                    working_stream_->get();
+                    Advance();
                     break;
                 } else {
                     this_token_ = MakeLongToken(accum_token);
@@ -157,7 +158,7 @@ public:
             } else if (cur == '-') {
                 if (!accum_token.empty()) {
                     if (isalpha(accum_token.at(0))) {
-                        working_stream_->get();
+                        Advance();
                         accum_token += cur;
                     } else {
                         this_token_ = MakeLongToken(accum_token);
@@ -165,7 +166,7 @@ public:
                         break;
                     }
                 } else {
-                    working_stream_->get();
+                    Advance();
                     if (!isdigit(working_stream_->peek())) {
                         this_token_ = SymbolToken("-");
                         accum_token.clear();
@@ -183,6 +184,10 @@ public:
         if (std::get_if<NullToken>(&this_token_) != nullptr) {
             last_token_ = true;
         }
+#ifdef SCHEME_METRICS
+        SCHEME_METRICS_ADD(tokenizer_bytes, advanced_);
+        advanced_ = 0;
+#endif
     }
 
     Token GetToken() {
@@ -190,7 +195,18 @@ public:
     }
 
 private:
+    void Advance() {
+        working_stream_->get();
+#ifdef SCHEME_METRICS
+        ++advanced_;
+#endif
+    }
+
     Token this_token_;
     std::istream* working_stream_;
     bool last_token_;
+#ifdef SCHEME_METRICS
+    // Bytes consumed by the current Next(), reported once it returns.
+    uint64_t advanced_ = 0;
+#endif
 };